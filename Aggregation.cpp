@@ -0,0 +1,167 @@
+#include "Aggregation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
+double GroupRow::avg() const
+{
+    return count > 0 ? sum / count : 0.0;
+}
+
+HashAggregator::HashAggregator(GroupKey key, QueryField value, int bucketWidth)
+    : key(key), value(value), bucketWidth(bucketWidth > 0 ? bucketWidth : 1) {}
+
+int HashAggregator::groupOf(const Record &record) const
+{
+    if (key == GROUP_BY_VOTES_BUCKET)
+        return record.numVotes / bucketWidth * bucketWidth;
+    return (int)std::lround(record.averageRating);
+}
+
+std::vector<GroupRow> HashAggregator::run(const SimulatedDisk &disk, int numThreads) const
+{
+    const std::vector<Block> &blocks = disk.getBlocks();
+    numThreads = std::max(1, std::min(numThreads, (int)blocks.size()));
+
+    // Thread-local pre-aggregation, keyed by group, holding {count, sum}
+    typedef std::unordered_map<int, std::pair<size_t, double>> Table;
+    std::vector<Table> tables(numThreads);
+    auto worker = [&](int t) {
+        size_t first = blocks.size() * t / numThreads;
+        size_t last = blocks.size() * (t + 1) / numThreads;
+        Table &table = tables[t];
+        for (size_t b = first; b < last; b++)
+        {
+            for (const Record &record : blocks[b].records)
+            {
+                if (record.isDeleted())
+                    continue;
+                std::pair<size_t, double> &entry = table[groupOf(record)];
+                entry.first++;
+                entry.second += value == FIELD_NUM_VOTES ? (double)record.numVotes : (double)record.averageRating;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; t++)
+    {
+        threads.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    // Merge into the first table, then emit in group order
+    Table &merged = tables[0];
+    for (int t = 1; t < numThreads; t++)
+    {
+        for (const auto &entry : tables[t])
+        {
+            std::pair<size_t, double> &total = merged[entry.first];
+            total.first += entry.second.first;
+            total.second += entry.second.second;
+        }
+    }
+    std::vector<GroupRow> rows;
+    rows.reserve(merged.size());
+    for (const auto &entry : merged)
+    {
+        rows.push_back({entry.first, entry.second.first, entry.second.second});
+    }
+    std::sort(rows.begin(), rows.end(), [](const GroupRow &a, const GroupRow &b) { return a.group < b.group; });
+    return rows;
+}
+
+// Reference implementation: one ordered map, one pass, no threads
+std::vector<GroupRow> HashAggregator::runSingleThreaded(const SimulatedDisk &disk) const
+{
+    std::map<int, GroupRow> groups;
+    for (const Block &block : disk.getBlocks())
+    {
+        for (const Record &record : block.records)
+        {
+            if (record.isDeleted())
+                continue;
+            int group = groupOf(record);
+            GroupRow &row = groups.insert(std::make_pair(group, GroupRow{group, 0, 0.0})).first->second;
+            row.count++;
+            row.sum += value == FIELD_NUM_VOTES ? (double)record.numVotes : (double)record.averageRating;
+        }
+    }
+    std::vector<GroupRow> rows;
+    for (const auto &entry : groups)
+    {
+        rows.push_back(entry.second);
+    }
+    return rows;
+}
+
+// Same groups with the same counts, and sums equal up to the order of floating-point additions
+static bool sameGroups(const std::vector<GroupRow> &a, const std::vector<GroupRow> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].group != b[i].group || a[i].count != b[i].count ||
+            std::fabs(a[i].sum - b[i].sum) > 1e-9 * std::max(1.0, std::fabs(b[i].sum)))
+            return false;
+    }
+    return true;
+}
+
+void experimentGroupBy(SimulatedDisk &disk)
+{
+    if (disk.totalRecords() == 0)
+    {
+        std::cout << "The disk is empty, run experiment 1 first" << std::endl;
+        return;
+    }
+
+    struct GroupByQuery
+    {
+        const char *title;
+        const char *groupLabel;
+        HashAggregator aggregator;
+    };
+    const GroupByQuery queries[2] = {
+        {"averageRating by numVotes bucket of 10000", "numVotes from", HashAggregator(GROUP_BY_VOTES_BUCKET, FIELD_AVERAGE_RATING, 10000)},
+        {"numVotes by rounded averageRating", "averageRating", HashAggregator(GROUP_BY_ROUNDED_RATING, FIELD_NUM_VOTES)},
+    };
+
+    for (const GroupByQuery &query : queries)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<GroupRow> reference = query.aggregator.runSingleThreaded(disk);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> referenceDuration = end - start;
+
+        printHeader(query.title);
+        for (size_t i = 0; i < reference.size() && i < 10; i++)
+        {
+            const GroupRow &row = reference[i];
+            printKeyValue(std::string(query.groupLabel) + " " + std::to_string(row.group),
+                          "count " + std::to_string(row.count) + ", sum " + std::to_string(row.sum) + ", avg " + std::to_string(row.avg()));
+        }
+        if (reference.size() > 10)
+            printKeyValue("Groups not shown", std::to_string(reference.size() - 10));
+        printKeyValue("Single-threaded reference", std::to_string(referenceDuration.count()) + " milliseconds");
+
+        for (int numThreads = 1; numThreads <= 8; numThreads *= 2)
+        {
+            start = std::chrono::high_resolution_clock::now();
+            std::vector<GroupRow> rows = query.aggregator.run(disk, numThreads);
+            end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> duration = end - start;
+            printKeyValue("Hash aggregation, " + std::to_string(numThreads) + " thread(s)",
+                          std::to_string(duration.count()) + " milliseconds (" + (sameGroups(rows, reference) ? "matches" : "DIFFERS") + ")");
+        }
+    }
+    printKeyValue("Hardware threads", std::to_string(std::thread::hardware_concurrency()));
+}
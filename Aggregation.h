@@ -0,0 +1,45 @@
+#ifndef AGGREGATION_H
+#define AGGREGATION_H
+
+#include <vector>
+#include "Storage.h"
+#include "Query.h"
+
+// What the records are grouped on
+enum GroupKey
+{
+    GROUP_BY_VOTES_BUCKET,  // numVotes / bucketWidth * bucketWidth
+    GROUP_BY_ROUNDED_RATING // averageRating rounded to the nearest integer
+};
+
+// count, sum and avg of the aggregated field within one group
+struct GroupRow
+{
+    int group;
+    size_t count;
+    double sum;
+
+    double avg() const;
+};
+
+// Hash group-by over every record of a SimulatedDisk. Each thread aggregates a
+// contiguous range of blocks into its own hash table, and the tables are merged
+// once all threads are done, so the threads share nothing while they run.
+class HashAggregator
+{
+    GroupKey key;
+    QueryField value;
+    int bucketWidth;
+
+    int groupOf(const Record &record) const;
+
+public:
+    HashAggregator(GroupKey key, QueryField value, int bucketWidth = 1000);
+    std::vector<GroupRow> run(const SimulatedDisk &disk, int numThreads) const;
+    std::vector<GroupRow> runSingleThreaded(const SimulatedDisk &disk) const;
+};
+
+// Rating distribution by numVotes bucket and votes by rounded rating, for 1 to 8 threads, checked against the single-threaded result
+void experimentGroupBy(SimulatedDisk &disk);
+
+#endif // AGGREGATION_H
@@ -5,49 +5,66 @@
 #include <string>
 #include <vector>
 #include "BPlusTree.h"
+#include "Instrumentation.h"
 #include "Record.h"
 #include <queue>
 #include <set>
 #include <chrono>
+#include <random>
+#include <algorithm>
 
 using namespace std;
 
 // size of node = size of block = 200
-// size of node = 2 +4N + 4 + 8(N+1)
-// 200 = 12N +14
-// N = (200-14)/12
-const int N = (200 - 14) / 12;
+// size of node = 2 +4N + 4 + 8(N+1) + 8
+// 200 = 12N +22
+// N = (200-22)/12
+const int N = (200 - 22) / 12;
 
 Node::Node()
 {
+  INSTRUMENT_COUNT(COUNT_ALLOCATIONS);
   key = new int[N];
   ptr = new Node *[N + 1];
   records = new unsigned char *[N];
+  prev = nullptr;
 };
 
 BPlusTree::BPlusTree(){};
 
+BPlusTree::~BPlusTree() {
+  if (root != nullptr) deallocateSubtree(root);
+}
+
 void BPlusTree::insertKey(int x, unsigned char *record) {
+  INSTRUMENT_OPERATION(OP_INSERT);
   if (root == nullptr) {
     root = createNewLeafNode(x, record);
-    cout << "Root created:  " << x << endl;
+    if (verbose) cout << "Root created:  " << x << endl;
     ++nodes;
     ++levels;
     ++numKeys;
+    hasLastInsert = true;
+    lastInsertKey = x;
     return;
   }
 
-  Node* parent = traverseToLeafNode(x)[0];
-  Node* curNode = traverseToLeafNode(x)[1];
+  Node** path = traverseToLeafNode(x);
+  Node* parent = path[0];
+  Node* curNode = path[1];
+  delete[] path;
   int insertIndex = 0;
 
   while (insertIndex < curNode->size && x > curNode->key[insertIndex]) {
+    INSTRUMENT_COUNT(COUNT_KEY_COMPARISONS);
     ++insertIndex;
   }
+  INSTRUMENT_COUNT(COUNT_KEY_COMPARISONS);
 
   if (insertIndex < curNode->size && x == curNode->key[insertIndex]) {
     Node* curBuffer = curNode->ptr[insertIndex];
     while (curBuffer->ptr[0] != nullptr) {
+      INSTRUMENT_COUNT(COUNT_POSTING_HOPS);
       curBuffer = curBuffer->ptr[0];
     }
     if (curBuffer->size < N) {
@@ -66,17 +83,142 @@ void BPlusTree::insertKey(int x, unsigned char *record) {
     curNode->key[insertIndex] = x;
     curNode->ptr[insertIndex] = createNewBufferNode(x, record);
     ++curNode->size;
-    cout << "Inserted " << x << endl;
+    if (verbose) cout << "Inserted " << x << endl;
   }
   else {
     ++nodes;
     ++numKeys;
     splitLeafNode(curNode, x, record, parent);
-    cout << "Inserted " << x << endl;
+    if (verbose) cout << "Inserted " << x << endl;
   }
+  hasLastInsert = true;
+  lastInsertKey = x;
+}
+
+// Build the tree bottom-up from (key, record) pairs pulled from next until it returns false.
+// Keys must arrive in non-decreasing order. Leaves are filled to fillFactor * N keys and
+// linked both ways as they are written, then each internal level is built over the one
+// below. The last node of a level is merged with or evened out against its left
+// neighbour if it would otherwise be under half full. Returns false, keeping what was
+// loaded so far, if the tree was not empty or a key arrived out of order.
+bool BPlusTree::bulkLoad(const std::function<bool(int &key, unsigned char *&record)> &next, double fillFactor) {
+  if (root != nullptr) {
+    cerr << "bulkLoad needs an empty tree" << endl;
+    return false;
+  }
+  int leafCapacity = std::max((N + 1) / 2, std::min(N, (int)std::lround(fillFactor * N)));
+
+  std::vector<Node*> level;   // nodes of the level being built, left to right
+  std::vector<int> lowKeys;   // smallest key under each node of level
+  Node* leaf = nullptr;
+  Node* tail = nullptr;       // last buffer node of the current posting list
+  bool ordered = true;
+  int key;
+  unsigned char* record;
+  while (next(key, record)) {
+    if (leaf != nullptr && key == leaf->key[leaf->size - 1]) {
+      if (tail->size < N) {
+        tail->records[tail->size++] = record;
+      } else {
+        tail->ptr[0] = createNewBufferNode(key, record);
+        tail = tail->ptr[0];
+      }
+      continue;
+    }
+    if (leaf != nullptr && key < leaf->key[leaf->size - 1]) {
+      cerr << "bulkLoad keys out of order: " << key << " after " << leaf->key[leaf->size - 1] << endl;
+      ordered = false;
+      break;
+    }
+    if (leaf == nullptr || leaf->size == leafCapacity) {
+      Node* newLeaf = new Node;
+      newLeaf->IS_LEAF = true;
+      newLeaf->size = 0;
+      newLeaf->ptr[N] = nullptr;
+      newLeaf->prev = leaf;
+      if (leaf != nullptr) leaf->ptr[N] = newLeaf;
+      leaf = newLeaf;
+      level.push_back(leaf);
+      lowKeys.push_back(key);
+      ++nodes;
+    }
+    tail = createNewBufferNode(key, record);
+    leaf->key[leaf->size] = key;
+    leaf->ptr[leaf->size] = tail;
+    ++leaf->size;
+    ++numKeys;
+  }
+  if (level.empty()) {
+    return ordered;
+  }
+
+  // An underfull last leaf is merged into its left neighbour, or the two share their keys evenly
+  if (level.size() > 1 && leaf->size < (N + 1) / 2) {
+    Node* left = leaf->prev;
+    int total = left->size + leaf->size;
+    if (total <= N) {
+      for (int i = 0; i < leaf->size; ++i) {
+        left->key[left->size + i] = leaf->key[i];
+        left->ptr[left->size + i] = leaf->ptr[i];
+      }
+      left->size = total;
+      left->ptr[N] = nullptr;
+      deallocate(leaf);
+      level.pop_back();
+      lowKeys.pop_back();
+      --nodes;
+    } else {
+      int move = total / 2 - leaf->size;
+      for (int i = leaf->size - 1; i >= 0; --i) {
+        leaf->key[i + move] = leaf->key[i];
+        leaf->ptr[i + move] = leaf->ptr[i];
+      }
+      for (int i = 0; i < move; ++i) {
+        leaf->key[i] = left->key[left->size - move + i];
+        leaf->ptr[i] = left->ptr[left->size - move + i];
+      }
+      left->size -= move;
+      leaf->size += move;
+      lowKeys.back() = leaf->key[0];
+    }
+  }
+  levels = 1;
+
+  // Internal levels: up to N + 1 children per node, the last two nodes evened out
+  while (level.size() > 1) {
+    std::vector<Node*> parents;
+    std::vector<int> parentLowKeys;
+    size_t count = level.size();
+    size_t minChildren = (N + 2) / 2;
+    size_t first = 0;
+    while (first < count) {
+      size_t children = std::min((size_t)N + 1, count - first);
+      size_t remaining = count - first - children;
+      if (remaining > 0 && remaining < minChildren) {
+        children = (children + remaining + 1) / 2; // share with the last node
+      }
+      Node* parent = new Node;
+      parent->IS_LEAF = false;
+      parent->size = (int)children - 1;
+      for (size_t c = 0; c < children; ++c) {
+        parent->ptr[c] = level[first + c];
+        if (c > 0) parent->key[c - 1] = lowKeys[first + c];
+      }
+      parents.push_back(parent);
+      parentLowKeys.push_back(lowKeys[first]);
+      ++nodes;
+      first += children;
+    }
+    level.swap(parents);
+    lowKeys.swap(parentLowKeys);
+    ++levels;
+  }
+  root = level[0];
+  return ordered;
 }
 
 void BPlusTree::splitLeafNode(Node* curNode, int x, unsigned char* record, Node* parent) {
+  INSTRUMENT_COUNT(COUNT_SPLITS);
   Node* newLeaf = new Node;
   int tempKeys[N + 1];
   Node* tempPtrs[N + 1];
@@ -97,7 +239,13 @@ void BPlusTree::splitLeafNode(Node* curNode, int x, unsigned char* record, Node*
       tempPtrs[i] = curNode->ptr[i - 1];
     }
   }
-  curNode->size = (N + 1) / 2;
+  // An append split leaves the old leaf nearly full; the keys that follow go to the new one
+  bool append = false;
+  if (insertIndex == N) {
+    append = (splitPolicy == SPLIT_RIGHTMOST && curNode->ptr[N] == nullptr) ||
+             (splitPolicy == SPLIT_ADAPTIVE && hasLastInsert && lastInsertKey == curNode->key[N - 1]);
+  }
+  curNode->size = splitPoint(N + 1, append);
   newLeaf->size = (N + 1) - curNode->size;
   for (int i = 0; i < curNode->size; ++i) {
     curNode->key[i] = tempKeys[i];
@@ -110,15 +258,28 @@ void BPlusTree::splitLeafNode(Node* curNode, int x, unsigned char* record, Node*
 
   newLeaf->ptr[N] = curNode->ptr[N];
   curNode->ptr[N] = newLeaf;
+  newLeaf->prev = curNode;
+  if (newLeaf->ptr[N] != nullptr) {
+    newLeaf->ptr[N]->prev = newLeaf;
+  }
   newLeaf->IS_LEAF = true;
 
   if (curNode == root) {
     createNewRoot(curNode, newLeaf);
   } else {
+    appendSplit = append;
     insertInternal(newLeaf->key[0], parent, newLeaf);
+    appendSplit = false;
   }
 }
 
+// Entries kept by the left node when a node holding entries entries is split. An append
+// split moves only about a tenth of them, at least one, to the new right node.
+int BPlusTree::splitPoint(int entries, bool append) const {
+  if (!append) return entries / 2;
+  return entries - std::max(1, entries / 10);
+}
+
 void BPlusTree::createNewRoot(Node* leftChild, Node* rightChild) {
   Node* newRoot = new Node();
 
@@ -128,6 +289,7 @@ void BPlusTree::createNewRoot(Node* leftChild, Node* rightChild) {
   newRoot->IS_LEAF = false;
   newRoot->size = 1;
   root = newRoot;
+  ++nodes;
   ++levels;
 }
 
@@ -145,6 +307,7 @@ void BPlusTree::insertInternal(int x, Node *parent, Node *child) {
         parent->ptr[pos + 1] = child;
         parent->size++;
     } else {
+        INSTRUMENT_COUNT(COUNT_SPLITS);
         this->nodes++;
         Node *splitNode = new Node();
         int tempKeys[N + 1];
@@ -165,8 +328,14 @@ void BPlusTree::insertInternal(int x, Node *parent, Node *child) {
         }
         tempPointers[idx + 1] = child;
         splitNode->IS_LEAF = false;
-        parent->size = (N + 1) / 2;
+        // Follows an append split below when the new separator is also the last one here.
+        // Of the N + 1 keys one moves up, so the right node still gets at least one.
+        bool append = appendSplit && idx == N;
+        parent->size = append ? splitPoint(N + 1, true) - 1 : (N + 1) / 2;
         splitNode->size = N - parent->size;
+        // Left half (plus the separator moving up) goes back into parent
+        memcpy(parent->key, tempKeys, (parent->size + 1) * sizeof(int));
+        memcpy(parent->ptr, tempPointers, (parent->size + 1) * sizeof(Node *));
         memcpy(splitNode->key, tempKeys + parent->size + 1, splitNode->size * sizeof(int));
         memcpy(splitNode->ptr, tempPointers + parent->size + 1, (splitNode->size + 1) * sizeof(Node *));
         if (parent == root) {
@@ -185,96 +354,50 @@ void BPlusTree::insertInternal(int x, Node *parent, Node *child) {
     }
 }
 
-void BPlusTree::experiment3(int numVotesToRetrieve)
+void BPlusTree::experiment3(int numVotesToRetrieve, const SimulatedDisk &disk)
 {
-  int indexNodesAccessed = 0;
-  int dataBlocksAccessed = 0;
+  AccessStats access;
   double totalRatings = 0.0;
-  int recordsAccessed = 0; // The number of records examined
   int matchingRecordsCount = 0;
+  std::vector<unsigned char *> recordsRead; // Resolved to data blocks after timing
 
   auto targetedSearchStart = std::chrono::high_resolution_clock::now();
 
-  
-  Node *current = root;
-  while (current != nullptr && !current->IS_LEAF)
+  // One descent to the leaf holding the key, then only its posting list
+  for (PostingIterator it = lookup(numVotesToRetrieve, &access); it.valid(); ++it)
   {
-    current = current->ptr[0]; // Traverse down to the leftmost leaf
-    indexNodesAccessed++;
-  }
-
-  // Start iterating through leaf nodes
-  while (current != nullptr)
-  {
-    dataBlocksAccessed++;
-    for (int i = 0; i < current->size; i++)
+    recordsRead.push_back(*it);
+    Record *record = reinterpret_cast<Record *>(*it);
+    if (record->numVotes == numVotesToRetrieve)
     {
-      if (current->key[i] == numVotesToRetrieve)
-      {
-        // Access the buffer node linked to this key
-        Node *bufferNode = current->ptr[i];
-        while (bufferNode != nullptr)
-        {
-          for (int j = 0; j < bufferNode->size; j++)
-          {
-            recordsAccessed++; // Incremented for each record examined
-            Record *record = reinterpret_cast<Record *>(bufferNode->records[j]);
-            if (record->numVotes == numVotesToRetrieve)
-            {
-              totalRatings += record->averageRating;
-              matchingRecordsCount++;
-            }
-          }
-          bufferNode = bufferNode->ptr[0]; 
-        }
-      }
+      totalRatings += record->averageRating;
+      matchingRecordsCount++;
     }
-    current = current->ptr[N]; // Move to the next leaf node. 
   }
 
   auto targetedSearchEnd = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double, std::milli> targetedDuration = targetedSearchEnd - targetedSearchStart;
 
+  std::set<long> dataBlocksRead; // Distinct data blocks holding the records examined
+  for (unsigned char *recordPtr : recordsRead)
+  {
+    dataBlocksRead.insert(disk.blockIdOf(recordPtr));
+  }
+
   double averageRating = matchingRecordsCount > 0 ? totalRatings / matchingRecordsCount : 0.0;
-  // Brute-force linear scan
-  int bruteForceDataBlocksAccessed = 0;
-  int bruteForceRecordsAccessed = 0;
+  // Brute-force scan over the data blocks, skipping blocks ruled out by their zone map or Bloom filter
+  ScanPredicate predicate;
+  predicate.minVotes = numVotesToRetrieve;
+  predicate.maxVotes = numVotesToRetrieve;
+  ScanStats bruteForceStats;
   double bruteForceTotalRatings = 0.0;
   int bruteForceMatchingRecordsCount = 0;
   auto bruteForceStart = std::chrono::high_resolution_clock::now();
 
-  // Re-initialize traversal from the root to the leftmost leaf for a full scan
-  Node *bruteCurrent = root;
-  while (bruteCurrent != nullptr && !bruteCurrent->IS_LEAF)
-  {
-    bruteCurrent = bruteCurrent->ptr[0]; // Navigate to the leftmost leaf
-  }
-
-  // Start brute-force scan iterating through all leaf nodes
-  while (bruteCurrent != nullptr)
-  {
-    bruteForceDataBlocksAccessed++;
-    for (int i = 0; i < bruteCurrent->size; i++)
-    {
-      // Instead of checking the key, directly access all records
-      Node *bufferNode = bruteCurrent->ptr[i];
-      while (bufferNode != nullptr)
-      {
-        for (int j = 0; j < bufferNode->size; j++)
-        {
-          Record *record = reinterpret_cast<Record *>(bufferNode->records[j]);
-          bruteForceRecordsAccessed++; // Correctly count each inspected record
-          if (record->numVotes == numVotesToRetrieve)
-          {
-            bruteForceTotalRatings += record->averageRating;
-            bruteForceMatchingRecordsCount++;
-          }
-        }
-        bufferNode = bufferNode->ptr[0]; // Move to the next buffer node
-      }
-    }
-    bruteCurrent = bruteCurrent->ptr[N]; // Moving to the next leaf node
-  }
+  disk.scan(predicate, [&](const Record &record) {
+    bruteForceTotalRatings += record.averageRating;
+    bruteForceMatchingRecordsCount++;
+  }, bruteForceStats);
 
   auto bruteForceEnd = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double, std::milli> bruteForceDuration = bruteForceEnd - bruteForceStart;
@@ -282,27 +405,30 @@ void BPlusTree::experiment3(int numVotesToRetrieve)
   double bruteForceAverageRating = bruteForceMatchingRecordsCount > 0 ? bruteForceTotalRatings / bruteForceMatchingRecordsCount : 0.0;
 
   std::cout << "Experiment 3 Statistics:" << std::endl;
-  std::cout << "Number of index nodes accessed: " << indexNodesAccessed << std::endl;
-  std::cout << "Number of data blocks accessed: " << dataBlocksAccessed << std::endl;
-  std::cout << "Number of records accessed: " << recordsAccessed << std::endl; //
+  std::cout << "Number of index nodes accessed: " << access.indexNodes + access.leafNodes << std::endl;
+  std::cout << "Number of leaf nodes accessed: " << access.leafNodes << std::endl;
+  std::cout << "Number of records accessed: " << access.records << std::endl;
+  std::cout << "Number of distinct data blocks read: " << dataBlocksRead.size() << std::endl;
   std::cout << "Average rating of matching records: " << averageRating << std::endl;
   std::cout << "Running time of the retrieval process: " << targetedDuration.count() << " milliseconds." << std::endl;
 
   // Display statistics for brute-force scan
   std::cout << "\nBrute-Force Scan Statistics:" << std::endl;
-  std::cout << "Number of data blocks accessed: " << bruteForceDataBlocksAccessed << std::endl;
-  std::cout << "Number of records accessed: " << bruteForceRecordsAccessed << std::endl; //
+  std::cout << "Number of data blocks accessed: " << bruteForceStats.blocksAccessed << std::endl;
+  std::cout << "Number of data blocks pruned: " << bruteForceStats.blocksPruned << std::endl;
+  std::cout << "Number of records accessed: " << bruteForceStats.recordsAccessed << std::endl;
   std::cout << "Average rating of matching records: " << bruteForceAverageRating << std::endl;
   std::cout << "Running time of the brute-force scan process: " << bruteForceDuration.count() << " milliseconds." << std::endl;
 }
 
-void BPlusTree::experiment4(int minVotes, int maxVotes)
+void BPlusTree::experiment4(int minVotes, int maxVotes, const SimulatedDisk &disk)
 {
   int indexNodesAccessed = 0;
   int dataBlocksAccessed = 0;
   int recordsAccessed = 0;
   double totalRatings = 0.0;
   int matchingRecordsCount = 0;
+  std::vector<unsigned char *> recordsRead; // Resolved to data blocks after timing
   auto start = std::chrono::high_resolution_clock::now();
 
   // Start with the root and traverse down to the first relevant leaf node
@@ -342,6 +468,7 @@ void BPlusTree::experiment4(int minVotes, int maxVotes)
 
           {
             recordsAccessed++;
+            recordsRead.push_back(bufferNode->records[j]);
             Record *record = reinterpret_cast<Record *>(bufferNode->records[j]);
             totalRatings += record->averageRating;
             matchingRecordsCount++;
@@ -358,46 +485,27 @@ void BPlusTree::experiment4(int minVotes, int maxVotes)
   auto end = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double, std::milli> duration = end - start;
 
+  std::set<long> dataBlocksRead; // Distinct data blocks holding the records examined
+  for (unsigned char *recordPtr : recordsRead)
+  {
+    dataBlocksRead.insert(disk.blockIdOf(recordPtr));
+  }
+
   double averageRating = (matchingRecordsCount > 0) ? totalRatings / matchingRecordsCount : 0.0;
 
-  int bruteForceDataBlocksAccessed = 0;
-  int bruteForceRecordsAccessed = 0;
+  // Brute-force scan over the data blocks, skipping blocks whose zone map lies outside the range
+  ScanPredicate predicate;
+  predicate.minVotes = minVotes;
+  predicate.maxVotes = maxVotes;
+  ScanStats bruteForceStats;
   double bruteForceTotalRatings = 0.0;
   int bruteForceMatchingRecordsCount = 0;
   auto bruteStart = std::chrono::high_resolution_clock::now();
 
-  Node *bruteCurrent = root;
-  while (bruteCurrent != nullptr && !bruteCurrent->IS_LEAF)
-  {
-    // Navigate to the leftmost leaf without checking keys
-    bruteCurrent = bruteCurrent->ptr[0];
-  }
-
-  // Start brute-force scan iterating through all leaf nodes
-  while (bruteCurrent != nullptr)
-  {
-    bruteForceDataBlocksAccessed++;
-    for (int i = 0; i < bruteCurrent->size; i++)
-    {
-      // Directly access all records without key-based filtering
-      Node *bufferNode = bruteCurrent->ptr[i];
-      while (bufferNode != nullptr)
-      {
-        for (int j = 0; j < bufferNode->size; j++)
-        {
-          bruteForceRecordsAccessed++; // Count each inspected record
-          Record *record = reinterpret_cast<Record *>(bufferNode->records[j]);
-          if (record->numVotes >= minVotes && record->numVotes <= maxVotes)
-          {
-            bruteForceTotalRatings += record->averageRating;
-            bruteForceMatchingRecordsCount++;
-          }
-        }
-        bufferNode = bufferNode->ptr[0]; // Move to the next buffer node
-      }
-    }
-    bruteCurrent = bruteCurrent->ptr[N]; // Move to the next leaf node
-  }
+  disk.scan(predicate, [&](const Record &record) {
+    bruteForceTotalRatings += record.averageRating;
+    bruteForceMatchingRecordsCount++;
+  }, bruteForceStats);
 
   auto bruteEnd = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double, std::milli> bruteDuration = bruteEnd - bruteStart;
@@ -408,18 +516,21 @@ void BPlusTree::experiment4(int minVotes, int maxVotes)
   std::cout << "Number of index nodes accessed: " << indexNodesAccessed << "\n";
   std::cout << "Number of data blocks accessed: " << dataBlocksAccessed << "\n";
   std::cout << "Number of records accessed: " << recordsAccessed << "\n";
+  std::cout << "Number of distinct data blocks read: " << dataBlocksRead.size() << "\n";
   std::cout << "Average rating of matching records: " << averageRating << "\n";
   std::cout << "Running time of the retrieval process: " << duration.count() << " milliseconds.\n";
 
   // Display the statistics for brute-force scan
   std::cout << "\nBrute-Force Scan Statistics:\n";
-  std::cout << "Number of data blocks accessed: " << bruteForceDataBlocksAccessed << "\n";
-  std::cout << "Number of records accessed: " << bruteForceRecordsAccessed << "\n";
+  std::cout << "Number of data blocks accessed: " << bruteForceStats.blocksAccessed << "\n";
+  std::cout << "Number of data blocks pruned: " << bruteForceStats.blocksPruned << "\n";
+  std::cout << "Number of records accessed: " << bruteForceStats.recordsAccessed << "\n";
   std::cout << "Average rating of matching records: " << bruteForceAverageRating << "\n";
   std::cout << "Running time of the brute-force scan process: " << bruteDuration.count() << " milliseconds.\n";
 }
 
 void BPlusTree::search(int x) {
+  INSTRUMENT_OPERATION(OP_LOOKUP);
   // Check for non-empty tree
   if (root == nullptr) {
     cout << "Not found\n";
@@ -427,7 +538,7 @@ void BPlusTree::search(int x) {
   }
 
   // Traverse to the potential leaf node containing x
-  Node* curNode = traverseToLeafNode(x)[1];
+  Node* curNode = findLeaf(x, nullptr);
   
   // Iterate over keys in the current node
   for (int i = 0; i < curNode->size; ++i) {
@@ -451,12 +562,502 @@ void BPlusTree::search(int x) {
   cout << "Not found\n";
 }
 
+// Posting list (first buffer node) of key x, or nullptr. Same descent as search, without output
+Node* BPlusTree::findPostingList(int x) {
+  if (root == nullptr) {
+    return nullptr;
+  }
+  Node* curNode = findLeaf(x, nullptr);
+  int* slot = std::lower_bound(curNode->key, curNode->key + curNode->size, x);
+  if (slot != curNode->key + curNode->size && *slot == x) return curNode->ptr[slot - curNode->key];
+  return nullptr;
+}
+
+// Equality probe: one root-to-leaf descent, then an iterator over the records of key x.
+// The iterator is empty when x is not in the tree.
+PostingIterator BPlusTree::lookup(int x, AccessStats *stats) const {
+  INSTRUMENT_OPERATION(OP_LOOKUP);
+  if (root == nullptr) {
+    return PostingIterator(nullptr, stats);
+  }
+  Node* leaf = findLeaf(x, stats);
+  int* slot = std::lower_bound(leaf->key, leaf->key + leaf->size, x, CountingLess());
+  if (slot == leaf->key + leaf->size || *slot != x) {
+    return PostingIterator(nullptr, stats);
+  }
+  return PostingIterator(leaf->ptr[slot - leaf->key], stats);
+}
+
+PostingIterator::PostingIterator(Node *buffer, AccessStats *stats) : buffer(buffer), slot(0), stats(stats) {
+  skipEmpty();
+}
+
+void PostingIterator::skipEmpty() {
+  while (buffer != nullptr && slot >= buffer->size) {
+    if (buffer->ptr[0] != nullptr) INSTRUMENT_COUNT_AS(OP_LOOKUP, COUNT_POSTING_HOPS);
+    buffer = buffer->ptr[0];
+    slot = 0;
+  }
+  if (buffer != nullptr && stats) stats->records++;
+}
+
+bool PostingIterator::valid() const {
+  return buffer != nullptr;
+}
+
+unsigned char* PostingIterator::operator*() const {
+  return buffer->records[slot];
+}
+
+PostingIterator& PostingIterator::operator++() {
+  ++slot;
+  skipEmpty();
+  return *this;
+}
+
+// Look up count keys at once, moving the whole group down one level at a time.
+// Each node is prefetched a full pass before it is read, so the cache misses of
+// the different lookups overlap instead of stalling one traversal after another.
+void BPlusTree::batchSearch(const int* keys, int count, Node** postings) {
+  if (root == nullptr) {
+    std::fill(postings, postings + count, (Node*)nullptr);
+    return;
+  }
+
+  std::vector<Node*> cur(count, root);
+  bool atLeaf = root->IS_LEAF; // the tree is balanced, every lookup reaches the leaves together
+  while (true) {
+    // Stage 1: nodes were prefetched on the previous pass, now fetch their key and pointer arrays
+    for (int i = 0; i < count; ++i) {
+      __builtin_prefetch(cur[i]->key);
+      __builtin_prefetch(cur[i]->ptr);
+    }
+    if (atLeaf) break;
+
+    // Stage 2: pick the child of every lookup and prefetch it for the next level
+    for (int i = 0; i < count; ++i) {
+      Node* node = cur[i];
+      int child = 0;
+      while (child < node->size && keys[i] >= node->key[child]) {
+        ++child;
+      }
+      cur[i] = node->ptr[child];
+      __builtin_prefetch(cur[i]);
+    }
+    atLeaf = cur[0]->IS_LEAF;
+  }
+
+  for (int i = 0; i < count; ++i) {
+    Node* leaf = cur[i];
+    postings[i] = nullptr;
+    for (int j = 0; j < leaf->size; ++j) {
+      if (leaf->key[j] == keys[i]) {
+        postings[i] = leaf->ptr[j];
+        break;
+      }
+    }
+  }
+}
+
+// Throughput of batchSearch against one findPostingList call per key
+void BPlusTree::experimentBatchedLookups(int numLookups) {
+  std::vector<int> allKeys;
+  Node* current = root;
+  while (current != nullptr && !current->IS_LEAF) {
+    current = current->ptr[0];
+  }
+  for (; current != nullptr; current = current->ptr[N]) {
+    allKeys.insert(allKeys.end(), current->key, current->key + current->size);
+  }
+  if (allKeys.empty()) {
+    cout << "The B+ tree is empty, run experiment 2 first" << endl;
+    return;
+  }
+
+  std::mt19937 rng(3020);
+  std::uniform_int_distribution<size_t> pick(0, allKeys.size() - 1);
+  std::vector<int> probes(numLookups);
+  for (int &probe : probes) {
+    probe = allKeys[pick(rng)];
+  }
+
+  std::vector<Node*> postings(numLookups);
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < numLookups; ++i) {
+    postings[i] = findPostingList(probes[i]);
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> loopDuration = end - start;
+
+  cout << "Batched Lookup Statistics (" << numLookups << " lookups):" << endl;
+  cout << "One lookup at a time: " << numLookups / loopDuration.count() / 1e6 << " million lookups/s" << endl;
+
+  for (int batchSize = 1; batchSize <= 64; batchSize *= 2) {
+    int found = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < numLookups; i += batchSize) {
+      batchSearch(&probes[i], std::min(batchSize, numLookups - i), &postings[i]);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> duration = end - start;
+    for (Node* posting : postings) {
+      if (posting != nullptr) ++found;
+    }
+    cout << "Batch size " << batchSize << ": " << numLookups / duration.count() / 1e6
+         << " million lookups/s (" << found << " found)" << endl;
+  }
+}
+
+// Look up many keys with one pass over the leaf level. The probes are sorted and
+// merged against the leaf chain; the tree is only re-descended from the root when
+// the next probe is estimated to be at least a tree height of leaves away.
+// Returns the records of every key, in the order of keys.
+std::vector<std::vector<unsigned char *>> BPlusTree::multiSearch(const std::vector<int> &keys, int *nodesVisited, int *redescents) {
+  std::vector<std::vector<unsigned char *>> results(keys.size());
+  AccessStats stats;
+  int descents = 0;
+  if (root == nullptr || keys.empty()) {
+    if (nodesVisited) *nodesVisited = 0;
+    if (redescents) *redescents = 0;
+    return results;
+  }
+
+  // (key, input position) pairs sorted by key; the sort is skipped for input already in order
+  std::vector<std::pair<int, int>> order(keys.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = std::make_pair(keys[i], (int)i);
+  if (!std::is_sorted(keys.begin(), keys.end())) std::sort(order.begin(), order.end());
+
+  int height = 1;
+  for (Node* node = root; !node->IS_LEAF; node = node->ptr[0]) ++height;
+
+  Node* leaf = findLeaf(order[0].first, &stats);
+  int pos = 0; // merge position inside the current leaf
+  for (const std::pair<int, int> &probe : order) {
+    int x = probe.first;
+    while (leaf->size == 0 || x > leaf->key[leaf->size - 1]) {
+      Node* next = leaf->ptr[N];
+      if (next == nullptr) break;
+      long long span = leaf->size > 0 ? (long long)leaf->key[leaf->size - 1] - leaf->key[0] + 1 : 1;
+      long long gapLeaves = leaf->size > 0 ? ((long long)x - leaf->key[leaf->size - 1]) / span : 0;
+      if (gapLeaves >= height) {
+        leaf = findLeaf(x, &stats); // cheaper to start again from the root than to walk the chain
+        ++descents;
+        pos = 0;
+        break;
+      }
+      leaf = next;
+      stats.leafNodes++;
+      pos = 0;
+    }
+
+    while (pos < leaf->size && leaf->key[pos] < x) ++pos;
+    if (pos < leaf->size && leaf->key[pos] == x) {
+      std::vector<unsigned char *> &records = results[probe.second];
+      for (Node* buffer = leaf->ptr[pos]; buffer != nullptr; buffer = buffer->ptr[0]) {
+        records.insert(records.end(), buffer->records, buffer->records + buffer->size);
+      }
+    }
+  }
+
+  if (nodesVisited) *nodesVisited = stats.indexNodes + stats.leafNodes;
+  if (redescents) *redescents = descents;
+  return results;
+}
+
+// IN-list lookups: multiSearch against one root-to-leaf descent per key. Most probes are
+// keys in the tree, missFraction of them values between keys that are not.
+void BPlusTree::experimentMultiSearch(int numKeys, double missFraction) {
+  if (root == nullptr) {
+    cout << "The B+ tree is empty, run experiment 2 first" << endl;
+    return;
+  }
+  std::vector<int> treeKeys;
+  Node* leaf = root;
+  while (!leaf->IS_LEAF) leaf = leaf->ptr[0];
+  for (; leaf != nullptr; leaf = leaf->ptr[N]) treeKeys.insert(treeKeys.end(), leaf->key, leaf->key + leaf->size);
+
+  std::vector<int> gaps; // values between two neighbouring keys
+  for (size_t i = 0; i + 1 < treeKeys.size(); ++i) {
+    if (treeKeys[i + 1] - treeKeys[i] > 1) gaps.push_back(treeKeys[i] + 1);
+  }
+
+  std::mt19937 rng(3020);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  std::vector<int> probes(numKeys);
+  int misses = 0;
+  for (int &probe : probes) {
+    if (!gaps.empty() && coin(rng) < missFraction) {
+      probe = gaps[rng() % gaps.size()];
+      ++misses;
+    } else {
+      probe = treeKeys[rng() % treeKeys.size()];
+    }
+  }
+
+  // Each side is timed over several alternating runs and the fastest run is reported
+  const int runs = 5;
+  double multiMs = 0, naiveMs = 0;
+  int nodesVisited = 0, redescents = 0;
+  size_t multiRecords = 0, naiveRecords = 0;
+  AccessStats naiveStats;
+  for (int run = 0; run < runs; ++run) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::vector<unsigned char *>> results = multiSearch(probes, &nodesVisited, &redescents);
+    std::chrono::duration<double, std::milli> multiDuration = std::chrono::high_resolution_clock::now() - start;
+    multiMs = run == 0 ? multiDuration.count() : std::min(multiMs, multiDuration.count());
+    multiRecords = 0;
+    for (const std::vector<unsigned char *> &records : results) multiRecords += records.size();
+
+    naiveRecords = 0;
+    naiveStats = AccessStats();
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<std::vector<unsigned char *>> naiveResults(probes.size());
+    for (size_t p = 0; p < probes.size(); ++p) {
+      Node* curNode = findLeaf(probes[p], &naiveStats);
+      int* slot = std::lower_bound(curNode->key, curNode->key + curNode->size, probes[p]);
+      if (slot != curNode->key + curNode->size && *slot == probes[p]) {
+        for (Node* buffer = curNode->ptr[slot - curNode->key]; buffer != nullptr; buffer = buffer->ptr[0]) {
+          naiveResults[p].insert(naiveResults[p].end(), buffer->records, buffer->records + buffer->size);
+        }
+      }
+    }
+    std::chrono::duration<double, std::milli> naiveDuration = std::chrono::high_resolution_clock::now() - start;
+    naiveMs = run == 0 ? naiveDuration.count() : std::min(naiveMs, naiveDuration.count());
+    for (const std::vector<unsigned char *> &records : naiveResults) naiveRecords += records.size();
+  }
+
+  cout << "Multi-Key Lookup Statistics (" << numKeys << " keys, " << misses << " not in the tree):" << endl;
+  cout << "multiSearch index nodes accessed: " << nodesVisited << " (" << redescents << " re-descents)" << endl;
+  cout << "multiSearch records found: " << multiRecords << endl;
+  cout << "multiSearch running time: " << multiMs << " milliseconds (fastest of " << runs << ")." << endl;
+  cout << "One search per key index nodes accessed: " << naiveStats.indexNodes + naiveStats.leafNodes << endl;
+  cout << "One search per key records found: " << naiveRecords << endl;
+  cout << "One search per key running time: " << naiveMs << " milliseconds (fastest of " << runs << ")." << endl;
+}
+
+// Record pointers of every key in [minKey, maxKey], in key order
+std::vector<unsigned char *> BPlusTree::rangeSearch(int minKey, int maxKey, AccessStats *stats) const {
+  INSTRUMENT_OPERATION(OP_RANGE);
+  std::vector<unsigned char *> result;
+  if (root == nullptr) {
+    return result;
+  }
+
+  Node* curNode = findLeaf(minKey, stats);
+
+  while (curNode != nullptr) {
+    for (int i = 0; i < curNode->size; ++i) {
+      INSTRUMENT_ADD(COUNT_KEY_COMPARISONS, 2);
+      if (curNode->key[i] > maxKey) {
+        if (stats) stats->records += (int)result.size();
+        return result;
+      }
+      if (curNode->key[i] < minKey) continue;
+      for (Node* buffer = curNode->ptr[i]; buffer != nullptr; buffer = buffer->ptr[0]) {
+        if (buffer != curNode->ptr[i]) INSTRUMENT_COUNT(COUNT_POSTING_HOPS);
+        result.insert(result.end(), buffer->records, buffer->records + buffer->size);
+      }
+    }
+    curNode = curNode->ptr[N];
+    if (curNode != nullptr) INSTRUMENT_COUNT(COUNT_NODE_VISITS);
+    if (stats && curNode != nullptr) stats->leafNodes++;
+  }
+  if (stats) stats->records += (int)result.size();
+  return result;
+}
+
+// Cursor on the largest key not above maxKey, moving towards smaller keys through the prev links
+ReverseCursor BPlusTree::reverseScan(int maxKey, AccessStats *stats) const {
+  if (root == nullptr) {
+    return ReverseCursor(nullptr, -1, stats);
+  }
+  Node* leaf = findLeaf(maxKey, stats);
+  int slot = (int)(std::upper_bound(leaf->key, leaf->key + leaf->size, maxKey) - leaf->key) - 1;
+  return ReverseCursor(leaf, slot, stats);
+}
+
+// The k records with the highest numVotes that satisfy predicate (every record when it is empty),
+// highest first. Stops reading the tree as soon as k records have been found.
+std::vector<unsigned char *> BPlusTree::topK(int k, const std::function<bool(const Record &)> &predicate, AccessStats *stats) const {
+  std::vector<unsigned char *> result;
+  if (k <= 0) {
+    return result;
+  }
+  for (ReverseCursor cursor = reverseScan(INT_MAX, stats); cursor.valid(); ++cursor) {
+    if (!predicate || predicate(*reinterpret_cast<const Record *>(*cursor))) {
+      result.push_back(*cursor);
+      if ((int)result.size() == k) break;
+    }
+  }
+  return result;
+}
+
+ReverseCursor::ReverseCursor(Node *leaf, int slot, AccessStats *stats) : leaf(leaf), slot(slot), stats(stats) {
+  settle();
+}
+
+// Step back over exhausted posting lists and leaves until a record is under the cursor
+void ReverseCursor::settle() {
+  while (leaf != nullptr) {
+    if (slot < 0) {
+      leaf = leaf->prev;
+      if (leaf == nullptr) return;
+      if (stats) stats->leafNodes++;
+      slot = leaf->size - 1;
+      continue;
+    }
+    if (!posting.valid()) {
+      posting = PostingIterator(leaf->ptr[slot], stats);
+      if (posting.valid()) return;
+      --slot;
+      continue;
+    }
+    return;
+  }
+}
+
+bool ReverseCursor::valid() const {
+  return leaf != nullptr;
+}
+
+int ReverseCursor::key() const {
+  return leaf->key[slot];
+}
+
+unsigned char* ReverseCursor::operator*() const {
+  return *posting;
+}
+
+ReverseCursor& ReverseCursor::operator++() {
+  ++posting;
+  if (!posting.valid()) {
+    --slot;
+    settle();
+  }
+  return *this;
+}
+
+// Top k titles by numVotes with and without a rating filter: reverse leaf scan against sorting every record
+void BPlusTree::experimentTopK(int k, const SimulatedDisk &disk) {
+  if (root == nullptr) {
+    cout << "The B+ tree is empty, run experiment 2 first" << endl;
+    return;
+  }
+
+  const float minRatings[2] = {0.0f, 8.0f};
+  for (float minRating : minRatings) {
+    AccessStats access;
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<unsigned char *> top = topK(k, [minRating](const Record &record) { return record.averageRating >= minRating; }, &access);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> topKDuration = end - start;
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<const Record *> all;
+    for (const Block &block : disk.getBlocks()) {
+      for (const Record &record : block.records) {
+        if (!record.isDeleted() && record.averageRating >= minRating) all.push_back(&record);
+      }
+    }
+    std::sort(all.begin(), all.end(), [](const Record *a, const Record *b) { return a->numVotes > b->numVotes; });
+    all.resize(std::min(all.size(), (size_t)k));
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> sortDuration = end - start;
+
+    bool same = top.size() == all.size();
+    for (size_t i = 0; same && i < top.size(); ++i) {
+      same = reinterpret_cast<Record *>(top[i])->numVotes == all[i]->numVotes;
+    }
+
+    cout << "Top " << k << " by numVotes with averageRating >= " << minRating << ":" << endl;
+    if (!top.empty()) {
+      Record* first = reinterpret_cast<Record *>(top.front());
+      cout << "Highest: " << std::string(first->tconst, strnlen(first->tconst, sizeof(first->tconst)))
+           << " (" << first->numVotes << " votes)" << endl;
+    }
+    cout << "Reverse scan leaf nodes accessed: " << access.leafNodes << endl;
+    cout << "Reverse scan records accessed: " << access.records << endl;
+    cout << "Reverse scan running time: " << topKDuration.count() << " milliseconds." << endl;
+    cout << "Sort-based running time: " << sortDuration.count() << " milliseconds." << endl;
+    cout << "Results agree: " << (same ? "yes" : "no") << endl;
+  }
+}
+
+// Number of levels, counted on the leftmost path
+int BPlusTree::height() const {
+  int h = 0;
+  for (Node* node = root; node != nullptr; node = node->IS_LEAF ? nullptr : node->ptr[0]) ++h;
+  return h;
+}
+
+// Number of leaf nodes, counted along the leaf chain
+int BPlusTree::leafCount() const {
+  Node* current = root;
+  while (current != nullptr && !current->IS_LEAF) current = current->ptr[0];
+  int leaves = 0;
+  for (; current != nullptr; current = current->ptr[N]) ++leaves;
+  return leaves;
+}
+
+int BPlusTree::keyCount() const {
+  return numKeys;
+}
+
+int BPlusTree::nodeCount() const {
+  return nodes;
+}
+
+void BPlusTree::setSplitPolicy(SplitPolicy policy) {
+  splitPolicy = policy;
+}
+
+SplitPolicy BPlusTree::getSplitPolicy() const {
+  return splitPolicy;
+}
+
+// Number of nodes and keys on every level, root first
+void BPlusTree::levelFill(std::vector<int> &nodesPerLevel, std::vector<int> &keysPerLevel) const {
+  nodesPerLevel.clear();
+  keysPerLevel.clear();
+  std::vector<Node*> level;
+  if (root != nullptr) level.push_back(root);
+  while (!level.empty()) {
+    std::vector<Node*> below;
+    int keys = 0;
+    for (Node* node : level) {
+      keys += node->size;
+      if (!node->IS_LEAF) {
+        for (int i = 0; i <= node->size; ++i) below.push_back(node->ptr[i]);
+      }
+    }
+    nodesPerLevel.push_back((int)level.size());
+    keysPerLevel.push_back(keys);
+    level.swap(below);
+  }
+}
+
+// Turn the per-operation messages of insertKey and deleteKey on or off
+void BPlusTree::setVerbose(bool on) {
+  verbose = on;
+}
+
+bool BPlusTree::isVerbose() const {
+  return verbose;
+}
+
 void BPlusTree::experiment2()
 {
   cout << "Experiment 2" << endl;
   cout << "Parameter N: " << N << endl;
   cout << "Number of Nodes: " << this->nodes << endl;
   cout << "Number of Levels: " << this->levels << endl;
+  std::vector<int> nodesPerLevel, keysPerLevel;
+  levelFill(nodesPerLevel, keysPerLevel);
+  for (size_t l = 0; l < nodesPerLevel.size(); l++)
+  {
+    cout << "Fill factor of level " << l + 1 << ": " << 100.0 * keysPerLevel[l] / ((double)nodesPerLevel[l] * N)
+         << "% (" << nodesPerLevel[l] << " nodes, " << keysPerLevel[l] << " keys)" << endl;
+  }
   cout << "Keys of Root Node:" << endl;
   if (root != NULL)
   {
@@ -467,7 +1068,7 @@ void BPlusTree::experiment2()
   }
 }
 
-void BPlusTree::experiment5(int numVotesToDelete)
+void BPlusTree::experiment5(int numVotesToDelete, SimulatedDisk &disk)
 {
   int bruteForceBlocksAccessed = 0;
   int totalCount = 0;
@@ -501,8 +1102,17 @@ void BPlusTree::experiment5(int numVotesToDelete)
   std::cout << "Found " << totalCount << " records with numVotes equal to " << numVotesToDelete << std::endl;
   std::cout << "Brute-force scan running time: " << bfDuration.count() << " milliseconds." << std::endl;
 
+  // The records go from the disk too, leaving tombstones that later inserts fill
   auto start = std::chrono::high_resolution_clock::now();
+  std::vector<unsigned char*> deletedRecords;
+  for (PostingIterator it = lookup(numVotesToDelete); it.valid(); ++it) {
+    deletedRecords.push_back(*it);
+  }
   deleteKey(numVotesToDelete);
+  int recordsDeleted = 0;
+  for (unsigned char* recordPtr : deletedRecords) {
+    if (disk.deleteRecord(recordPtr)) recordsDeleted++;
+  }
 
   auto end = std::chrono::high_resolution_clock::now();
   std::chrono::duration<double> duration = end - start;
@@ -528,6 +1138,8 @@ void BPlusTree::experiment5(int numVotesToDelete)
   }
   std::cout << std::endl;
   std::cout << "Running time of the deletion process: " << duration.count() << " millieconds." << std::endl;
+  std::cout << "Records deleted from the disk: " << recordsDeleted << std::endl;
+  std::cout << "Dead record bytes on the disk: " << disk.deadBytes() << " in " << disk.blocksWithHoles() << " blocks" << std::endl;
 }
 
 Node* BPlusTree::createNewLeafNode(int key, unsigned char* data) {
@@ -543,6 +1155,7 @@ Node* BPlusTree::createNewLeafNode(int key, unsigned char* data) {
     leafNode->size = 1;
     leafNode->ptr[0] = createNewBufferNode(key, data); // Link to buffer node containing the record
     leafNode->ptr[N] = nullptr; // Rightmost pointer in a leaf node is always null
+    leafNode->prev = nullptr;
 
     return leafNode;
 }
@@ -568,12 +1181,15 @@ Node **BPlusTree::traverseToLeafNode(int targetKey) {
     path[1] = root; // Start with the root
 
     // Traverse down to the leaf node
+    INSTRUMENT_COUNT(COUNT_NODE_VISITS);
     while (!path[1]->IS_LEAF) {
         path[0] = path[1]; // Update parent
         bool foundLesserKey = false; // Flag if a lesser key is found
 
         // Search for the first key greater than targetKey
+        INSTRUMENT_COUNT(COUNT_NODE_VISITS);
         for (int i = 0; i < path[1]->size; i++) {
+            INSTRUMENT_COUNT(COUNT_KEY_COMPARISONS);
             if (targetKey < path[1]->key[i]) {
                 path[1] = path[1]->ptr[i]; // Move to child node
                 foundLesserKey = true;
@@ -589,6 +1205,21 @@ Node **BPlusTree::traverseToLeafNode(int targetKey) {
     return path;
 }
 
+// Leaf that would hold x. Binary search in every internal node; a key equal to a
+// separator belongs to the right child, as in traverseToLeafNode.
+Node* BPlusTree::findLeaf(int x, AccessStats *stats) const {
+    Node* current = root;
+    INSTRUMENT_COUNT(COUNT_NODE_VISITS);
+    while (!current->IS_LEAF) {
+        if (stats) stats->indexNodes++;
+        int child = std::upper_bound(current->key, current->key + current->size, x, CountingLess()) - current->key;
+        current = current->ptr[child];
+        INSTRUMENT_COUNT(COUNT_NODE_VISITS);
+    }
+    if (stats) stats->leafNodes++;
+    return current;
+}
+
 Node* BPlusTree::findParent(Node* currentNode, Node* targetChild) {
     // stop if currentNode = leaf or child = leaf
     if (currentNode->IS_LEAF || (currentNode->ptr[0]->IS_LEAF)) {
@@ -613,16 +1244,20 @@ Node* BPlusTree::findParent(Node* currentNode, Node* targetChild) {
 }
 
 void BPlusTree::deleteKey(int x) {
+    INSTRUMENT_OPERATION(OP_DELETE);
     if (root == NULL)
         return;
 
     Node *curNode = root, *parent = nullptr;
     int leftPtrIndex, rightPtrIndex;
     int index = -1;
+    INSTRUMENT_COUNT(COUNT_NODE_VISITS);
     while (!curNode->IS_LEAF) {
         index = -1;
+        INSTRUMENT_COUNT(COUNT_NODE_VISITS);
         for (int i = 0; i < curNode->size; i++) {
             parent = curNode;
+            INSTRUMENT_COUNT(COUNT_KEY_COMPARISONS);
             if (x < curNode->key[i]) {
                 curNode = curNode->ptr[i];
                 index = i;
@@ -634,32 +1269,40 @@ void BPlusTree::deleteKey(int x) {
             curNode = curNode->ptr[curNode->size];
         }
         leftPtrIndex = index - 1;
-        rightPtrIndex = index;
+        rightPtrIndex = index + 1;
     }
 
     bool found = false;
     for (int i = 0; i < curNode->size; i++) {
+        INSTRUMENT_COUNT(COUNT_KEY_COMPARISONS);
         if (curNode->key[i] == x) {
+            for (Node *buffer = curNode->ptr[i]; buffer != nullptr;) {
+                Node *next = buffer->ptr[0];
+                if (next != nullptr) INSTRUMENT_COUNT(COUNT_POSTING_HOPS);
+                deallocate(buffer);
+                buffer = next;
+            }
             for (int j = i; j < curNode->size - 1; j++) {
                 curNode->key[j] = curNode->key[j + 1];
                 curNode->ptr[j] = curNode->ptr[j + 1];
             }
             curNode->size--;
             this->deleteCounter++;
+            --numKeys;
             found = true;
             break;
         }
     }
 
     if (!found) {
-        cout << "Key not found" << endl;
+        if (verbose) cout << "Key not found" << endl;
         return;
     }
 
     // Handle underflow in the leaf node
     if (curNode->size < (N + 1) / 2 && curNode != root) {
         Node *leftSibling = (leftPtrIndex >= 0) ? parent->ptr[leftPtrIndex] : nullptr;
-        Node *rightSibling = (rightPtrIndex < parent->size) ? parent->ptr[rightPtrIndex] : nullptr;
+        Node *rightSibling = (rightPtrIndex <= parent->size) ? parent->ptr[rightPtrIndex] : nullptr;
 
         if (leftSibling && leftSibling->size > (N + 1) / 2) {
             // Borrow from left sibling
@@ -685,6 +1328,7 @@ void BPlusTree::deleteKey(int x) {
             parent->key[rightPtrIndex - 1] = rightSibling->key[0];
         } else {
             // Merge with a sibling
+            INSTRUMENT_COUNT(COUNT_MERGES);
             if (leftSibling) {
                 // Merge curNode with leftSibling
                 for (int i = leftSibling->size, j = 0; j < curNode->size; i++, j++) {
@@ -692,8 +1336,12 @@ void BPlusTree::deleteKey(int x) {
                     leftSibling->ptr[i] = curNode->ptr[j];
                 }
                 leftSibling->size += curNode->size;
+                leftSibling->ptr[N] = curNode->ptr[N];
+                if (leftSibling->ptr[N] != nullptr)
+                    leftSibling->ptr[N]->prev = leftSibling;
                 deleteInternal(parent->key[leftPtrIndex], parent, curNode);
                 deallocate(curNode);
+                --nodes;
             } else if (rightSibling) {
                 // Merge curNode into rightSibling
                 for (int i = curNode->size, j = 0; j < rightSibling->size; i++, j++) {
@@ -701,30 +1349,42 @@ void BPlusTree::deleteKey(int x) {
                     curNode->ptr[i] = rightSibling->ptr[j];
                 }
                 curNode->size += rightSibling->size;
-                deleteInternal(parent->key[rightPtrIndex], parent, rightSibling);
+                curNode->ptr[N] = rightSibling->ptr[N];
+                if (curNode->ptr[N] != nullptr)
+                    curNode->ptr[N]->prev = curNode;
+                deleteInternal(parent->key[rightPtrIndex - 1], parent, rightSibling);
                 deallocate(rightSibling);
+                --nodes;
             }
         }
     }
 
-    cout << "Deleted key Successfully" << endl;
+    if (verbose) cout << "Deleted key Successfully" << endl;
 }
 
+// Remove child, and the separator x to its left, from internal node curNode.
+// An underflowing node borrows through the parent or is merged into a sibling,
+// and the merge is removed from the level above in the same way.
 void BPlusTree::deleteInternal(int x, Node* curNode, Node* child) {
     if (curNode == root && curNode->size == 1) {
         root = (curNode->ptr[0] == child) ? curNode->ptr[1] : curNode->ptr[0];
         deallocate(curNode);
-        cout << "Changed root node\n";
+        --nodes;
+        --levels;
+        if (verbose) cout << "Changed root node\n";
         return;
     }
 
     int index = -1;
-    for (int i = 0; i < curNode->size; i++) {
-        if (curNode->key[i] == x) {
-            index = i;
+    for (int i = 1; i <= curNode->size; i++) {
+        if (curNode->ptr[i] == child) {
+            index = i - 1;
             break;
         }
     }
+    if (index == -1 || curNode->key[index] != x) {
+        return;
+    }
 
     for (int i = index; i < curNode->size - 1; i++) {
         curNode->key[i] = curNode->key[i + 1];
@@ -748,6 +1408,8 @@ void BPlusTree::deleteInternal(int x, Node* curNode, Node* child) {
         Node* rightSibling = rightPtrIndex <= parent->size ? parent->ptr[rightPtrIndex] : nullptr;
 
         if (leftSibling && leftSibling->size > N / 2) {
+            // Rotate the last child of leftSibling through the parent
+            curNode->ptr[curNode->size + 1] = curNode->ptr[curNode->size];
             for (int i = curNode->size; i > 0; i--) {
                 curNode->key[i] = curNode->key[i - 1];
                 curNode->ptr[i] = curNode->ptr[i - 1];
@@ -758,53 +1420,76 @@ void BPlusTree::deleteInternal(int x, Node* curNode, Node* child) {
             leftSibling->size--;
             parent->key[leftPtrIndex] = leftSibling->key[leftSibling->size];
         } else if (rightSibling && rightSibling->size > N / 2) {
+            // Rotate the first child of rightSibling through the parent
             curNode->key[curNode->size] = parent->key[rightPtrIndex - 1];
             curNode->ptr[curNode->size + 1] = rightSibling->ptr[0];
             curNode->size++;
+            parent->key[rightPtrIndex - 1] = rightSibling->key[0];
             for (int i = 0; i < rightSibling->size - 1; i++) {
                 rightSibling->key[i] = rightSibling->key[i + 1];
+            }
+            for (int i = 0; i < rightSibling->size; i++) {
                 rightSibling->ptr[i] = rightSibling->ptr[i + 1];
             }
             rightSibling->size--;
-            parent->key[rightPtrIndex - 1] = rightSibling->key[0];
-        } else {
-            if (leftSibling) {
-                // Merge curNode with leftSibling
-                leftSibling->key[leftSibling->size] = parent->key[leftPtrIndex];
-                for (int i = leftSibling->size + 1, j = 0; j < curNode->size; i++, j++) {
-                    leftSibling->key[i] = curNode->key[j];
-                    leftSibling->ptr[i] = curNode->ptr[j];
-                }
-                leftSibling->size += curNode->size + 1;
-                // Adjust
-                for (int i = leftPtrIndex; i < parent->size - 1; i++) {
-                    parent->key[i] = parent->key[i + 1];
-                    parent->ptr[i + 1] = parent->ptr[i + 2];
-                }
-                parent->size--;
-                deallocate(curNode);
-            } else if (rightSibling) {
-                // Merge curNode into rightSibling
-                curNode->key[curNode->size] = parent->key[rightPtrIndex - 1];
-                for (int i = curNode->size + 1, j = 0; j < rightSibling->size; i++, j++) {
-                    curNode->key[i] = rightSibling->key[j];
-                    curNode->ptr[i] = rightSibling->ptr[j];
-                }
-                curNode->size += rightSibling->size + 1;
-                // Adjust
-                for (int i = rightPtrIndex - 1; i < parent->size - 1; i++) {
-                    parent->key[i] = parent->key[i + 1];
-                    parent->ptr[i + 1] = parent->ptr[i + 2];
-                }
-                parent->size--;
-                deallocate(rightSibling);
+        } else if (leftSibling) {
+            // Merge curNode into leftSibling, pulling down the separator
+            INSTRUMENT_COUNT(COUNT_MERGES);
+            leftSibling->key[leftSibling->size] = parent->key[leftPtrIndex];
+            for (int j = 0; j < curNode->size; j++) {
+                leftSibling->key[leftSibling->size + 1 + j] = curNode->key[j];
             }
-            if (parent->size < N / 2 && parent != root) {
-                Node* grandparent = findParent(root, parent);
-                deleteInternal(parent->key[0], grandparent, parent);
+            for (int j = 0; j <= curNode->size; j++) {
+                leftSibling->ptr[leftSibling->size + 1 + j] = curNode->ptr[j];
             }
+            leftSibling->size += curNode->size + 1;
+            deleteInternal(parent->key[leftPtrIndex], parent, curNode);
+            deallocate(curNode);
+            --nodes;
+        } else if (rightSibling) {
+            // Merge rightSibling into curNode, pulling down the separator
+            INSTRUMENT_COUNT(COUNT_MERGES);
+            curNode->key[curNode->size] = parent->key[rightPtrIndex - 1];
+            for (int j = 0; j < rightSibling->size; j++) {
+                curNode->key[curNode->size + 1 + j] = rightSibling->key[j];
+            }
+            for (int j = 0; j <= rightSibling->size; j++) {
+                curNode->ptr[curNode->size + 1 + j] = rightSibling->ptr[j];
+            }
+            curNode->size += rightSibling->size + 1;
+            deleteInternal(parent->key[rightPtrIndex - 1], parent, rightSibling);
+            deallocate(rightSibling);
+            --nodes;
+        }
+    }
+}
+
+// Point record payloads at their new addresses after the data file was reorganized
+void BPlusTree::remapRecords(const std::unordered_map<unsigned char *, unsigned char *> &relocated)
+{
+  Node *current = root;
+  while (current != nullptr && !current->IS_LEAF)
+  {
+    current = current->ptr[0];
+  }
+  while (current != nullptr)
+  {
+    for (int i = 0; i < current->size; i++)
+    {
+      for (Node *bufferNode = current->ptr[i]; bufferNode != nullptr; bufferNode = bufferNode->ptr[0])
+      {
+        for (int j = 0; j < bufferNode->size; j++)
+        {
+          auto it = relocated.find(bufferNode->records[j]);
+          if (it != relocated.end())
+          {
+            bufferNode->records[j] = it->second;
+          }
         }
+      }
     }
+    current = current->ptr[N];
+  }
 }
 
 // deletion helper function
@@ -812,5 +1497,64 @@ void BPlusTree::deallocate(Node *node)
 {
   delete[] node->key;
   delete[] node->ptr;
+  delete[] node->records;
   delete node;
-}
\ No newline at end of file
+}
+
+// Frees a subtree, including the buffer nodes of every posting list under it
+void BPlusTree::deallocateSubtree(Node *node)
+{
+  for (int i = 0; i < node->size; ++i) {
+    if (node->IS_LEAF) {
+      for (Node *buffer = node->ptr[i]; buffer != nullptr;) {
+        Node *next = buffer->ptr[0];
+        deallocate(buffer);
+        buffer = next;
+      }
+    } else {
+      deallocateSubtree(node->ptr[i]);
+    }
+  }
+  if (!node->IS_LEAF) deallocateSubtree(node->ptr[node->size]);
+  deallocate(node);
+}
+
+void experimentSplitPolicies(const SimulatedDisk &disk) {
+  if (disk.totalRecords() == 0) {
+    cout << "The disk is empty, run experiment 1 first" << endl;
+    return;
+  }
+
+  std::vector<std::pair<int, unsigned char*>> sorted = disk.numVotesEntries();
+  std::vector<std::pair<int, unsigned char*>> shuffled = sorted;
+  std::mt19937 rng(3020);
+  std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+  const std::vector<std::pair<int, unsigned char*>>* orders[2] = {&sorted, &shuffled};
+  const char* orderNames[2] = {"Inserts in numVotes order", "Inserts in random order"};
+  const SplitPolicy policies[3] = {SPLIT_EVEN, SPLIT_RIGHTMOST, SPLIT_ADAPTIVE};
+  const char* policyNames[3] = {"Even splits", "Rightmost 90/10", "Adaptive 90/10"};
+  for (int o = 0; o < 2; o++) {
+    printHeader(orderNames[o]);
+    for (int p = 0; p < 3; p++) {
+      BPlusTree tree;
+      tree.setVerbose(false);
+      tree.setSplitPolicy(policies[p]);
+      auto start = std::chrono::high_resolution_clock::now();
+      for (const std::pair<int, unsigned char*>& entry : *orders[o]) {
+        tree.insertKey(entry.first, entry.second);
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double, std::milli> duration = end - start;
+
+      std::vector<int> nodesPerLevel, keysPerLevel;
+      tree.levelFill(nodesPerLevel, keysPerLevel);
+      std::string fill;
+      for (size_t l = 0; l < nodesPerLevel.size(); l++) {
+        fill += (l == 0 ? "" : " / ") + std::to_string((int)std::lround(100.0 * keysPerLevel[l] / ((double)nodesPerLevel[l] * N))) + "%";
+      }
+      printKeyValue(policyNames[p], std::to_string(tree.nodeCount()) + " nodes, " + std::to_string(tree.height()) + " levels, fill by level " +
+                                        fill + ", " + std::to_string(duration.count()) + " milliseconds");
+    }
+  }
+}
@@ -7,12 +7,16 @@
 #include <stdio.h>
 #include <limits.h>
 #include <cmath>
+#include <unordered_map>
+#include <functional>
 #include "Storage.h"
 
 using namespace std;
 
 extern const int N; // Indicate that N is defined elsewhere
 
+class SimulatedDisk; // forward declare
+
 class Node {
 public:
     bool IS_LEAF; //2bytes
@@ -20,17 +24,73 @@ public:
     int size; //4bytes, the number of keys in the node
     Node **ptr; // Pointers to child nodes
     unsigned char **records; // Pointers to data records, for leaf nodes
+    Node *prev; //8bytes, previous leaf in key order, for leaf nodes
 
     Node();
 };
 
+// Where a full node is split when a key is added to it
+enum SplitPolicy {
+  SPLIT_EVEN,      // always (N + 1) / 2 entries on the left
+  SPLIT_RIGHTMOST, // 90/10 when the key goes past the end of the rightmost node at its level
+  SPLIT_ADAPTIVE   // 90/10 when the key goes past the end of a node that the previous insert appended to
+};
+
+// Per-query access counters
+struct AccessStats {
+    int indexNodes; // internal nodes visited
+    int leafNodes;  // leaf nodes visited
+    int records;    // records fetched through the index
+
+    AccessStats() : indexNodes(0), leafNodes(0), records(0) {}
+};
+
+// Walks the records of one posting list, following the buffer node chain
+class PostingIterator {
+    Node *buffer;
+    int slot;
+    AccessStats *stats;
+
+    void skipEmpty();
+
+public:
+    PostingIterator(Node *buffer = nullptr, AccessStats *stats = nullptr);
+    bool valid() const;
+    unsigned char *operator*() const;
+    PostingIterator &operator++();
+};
+
+// Walks the records of the tree from the largest key down, one posting list at a time
+class ReverseCursor {
+    Node *leaf;
+    int slot;
+    PostingIterator posting;
+    AccessStats *stats;
+
+    void settle();
+
+public:
+    ReverseCursor(Node *leaf, int slot, AccessStats *stats = nullptr);
+    bool valid() const;
+    int key() const;
+    unsigned char *operator*() const;
+    ReverseCursor &operator++();
+};
+
 class BPlusTree {
+    friend class TreeAnalyzer; // walks the nodes directly
     Node *root = NULL; //root node
     
     int nodes = 0;
     int levels = 0;
     int numKeys = 0;
     int deleteCounter = 0; // Keep track of deleted numVotes = 1000
+    bool verbose = true; // print a line for every insert and delete
+    SplitPolicy splitPolicy = SPLIT_ADAPTIVE;
+    bool hasLastInsert = false;
+    int lastInsertKey = 0;    // key of the previous insertKey call
+    bool appendSplit = false; // the leaf split of the current insert was an append split
+    int splitPoint(int entries, bool append) const;
     void insertInternal(int x, Node *parent, Node *child);
     void deleteInternal(int x, Node *curNode, Node *child);
     void splitLeafNode(Node* curNode, int x, unsigned char* record, Node* parent);
@@ -39,17 +99,46 @@ class BPlusTree {
     Node* createNewLeafNode(int key, unsigned char *data);
     Node* createNewBufferNode(int key, unsigned char *data);
     Node** traverseToLeafNode(int targetKey);
+    Node *findLeaf(int x, AccessStats *stats) const;
     void deallocate(Node *node);
+    void deallocateSubtree(Node *node);
 
 public:
     BPlusTree();
+    ~BPlusTree();
+    BPlusTree(const BPlusTree &) = delete; // owns its nodes
+    BPlusTree &operator=(const BPlusTree &) = delete;
     void search(int x);
+    Node *findPostingList(int x);
+    PostingIterator lookup(int x, AccessStats *stats = nullptr) const;
+    void batchSearch(const int *keys, int count, Node **postings);
+    std::vector<unsigned char *> rangeSearch(int minKey, int maxKey, AccessStats *stats = nullptr) const;
+    ReverseCursor reverseScan(int maxKey = INT_MAX, AccessStats *stats = nullptr) const;
+    std::vector<unsigned char *> topK(int k, const std::function<bool(const Record &)> &predicate = nullptr, AccessStats *stats = nullptr) const;
+    std::vector<std::vector<unsigned char *>> multiSearch(const std::vector<int> &keys, int *nodesVisited = nullptr, int *redescents = nullptr);
     void insertKey(int x,unsigned char *record);
+    bool bulkLoad(const std::function<bool(int &key, unsigned char *&record)> &next, double fillFactor = 1.0);
     void deleteKey(int x);
+    int height() const;
+    int nodeCount() const;
+    void setVerbose(bool on);
+    bool isVerbose() const;
+    int leafCount() const;
+    int keyCount() const;
+    void setSplitPolicy(SplitPolicy policy);
+    SplitPolicy getSplitPolicy() const;
+    void levelFill(std::vector<int> &nodesPerLevel, std::vector<int> &keysPerLevel) const;
     void experiment2();
-    void experiment5(int numVotesToDelete);
-    void experiment3(int numVotes);
-    void experiment4(int minVotes, int maxVotes);
+    void experiment5(int numVotesToDelete, SimulatedDisk &disk);
+    void experiment3(int numVotes, const SimulatedDisk &disk);
+    void experiment4(int minVotes, int maxVotes, const SimulatedDisk &disk);
+    void experimentBatchedLookups(int numLookups);
+    void experimentMultiSearch(int numKeys, double missFraction = 0.1);
+    void experimentTopK(int k, const SimulatedDisk &disk);
+    void remapRecords(const std::unordered_map<unsigned char *, unsigned char *> &relocated);
 };
 
+// Build trees from sorted and shuffled numVotes with every split policy and compare nodes, levels and fill
+void experimentSplitPolicies(const SimulatedDisk &disk);
+
 #endif
@@ -0,0 +1,486 @@
+#include "BlockReader.h"
+#include "BPlusTree.h"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#undef BLOCK_SIZE // <linux/fs.h> defines it as 1024, use the simulated block size from Storage.h
+#endif
+
+BlockFile::BlockFile(const std::string &filename) : filename(filename)
+{
+#ifdef _WIN32
+    fd = _open(filename.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    fd = open(filename.c_str(), O_RDONLY);
+#endif
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open file for reading: " << filename << std::endl;
+    }
+}
+
+BlockFile::~BlockFile()
+{
+    if (fd >= 0)
+    {
+#ifdef _WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+    }
+}
+
+bool BlockFile::isOpen() const
+{
+    return fd >= 0;
+}
+
+int BlockFile::descriptor() const
+{
+    return fd;
+}
+
+size_t BlockFile::totalBlocks() const
+{
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        return 0;
+    }
+    return (size_t)info.st_size / BLOCK_SIZE;
+}
+
+bool BlockFile::readBlock(uint32_t blockId, Block &block) const
+{
+    std::vector<unsigned char> buffer(BLOCK_SIZE);
+    off_t offset = (off_t)blockId * BLOCK_SIZE;
+#ifdef _WIN32
+    std::ifstream in(filename, std::ios::binary);
+    in.seekg(offset);
+    in.read(reinterpret_cast<char *>(buffer.data()), BLOCK_SIZE);
+    long bytes = (long)in.gcount();
+#else
+    long bytes = (long)pread(fd, buffer.data(), BLOCK_SIZE, offset);
+#endif
+    if (bytes < 0)
+    {
+        std::cerr << "Failed to read block " << blockId << " from " << filename << std::endl;
+        return false;
+    }
+    decodeBlock(buffer.data(), (size_t)bytes, block);
+    return true;
+}
+
+// Evict the file from the page cache so the next reads go to the device
+void BlockFile::dropCache() const
+{
+#if defined(__linux__)
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
+void BlockFile::decodeBlock(const unsigned char *buffer, size_t length, Block &block)
+{
+    block.records.clear();
+    for (size_t offset = 0; offset + sizeof(Record) <= length; offset += sizeof(Record))
+    {
+        Record record;
+        std::memcpy(&record, buffer + offset, sizeof(Record));
+        if (record.tconst[0] != '\0') // zero filled slots are unused
+        {
+            block.records.push_back(record);
+        }
+    }
+}
+
+#ifdef __linux__
+// Submission and completion rings shared with the kernel
+struct AsyncBlockReader::Ring
+{
+    int fd;
+    unsigned entries;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    io_uring_sqe *sqes;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    io_uring_cqe *cqes;
+};
+#else
+struct AsyncBlockReader::Ring
+{
+};
+#endif
+
+AsyncBlockReader::AsyncBlockReader(const BlockFile &file, int queueDepth, bool allowIoUring)
+    : file(file), queueDepth(queueDepth < 1 ? 1 : queueDepth), ring(nullptr)
+{
+    if (allowIoUring)
+    {
+        ring = setupRing((unsigned)this->queueDepth);
+    }
+}
+
+AsyncBlockReader::~AsyncBlockReader()
+{
+    teardownRing(ring);
+}
+
+bool AsyncBlockReader::usingIoUring() const
+{
+    return ring != nullptr;
+}
+
+bool AsyncBlockReader::readBlocks(const std::vector<uint32_t> &blockIds, const std::function<void(uint32_t, const Block &)> &onBlock)
+{
+    if (blockIds.empty())
+    {
+        return true;
+    }
+    if (ring != nullptr)
+    {
+        return readWithIoUring(blockIds, onBlock);
+    }
+    return readWithThreads(blockIds, onBlock);
+}
+
+#ifdef __linux__
+AsyncBlockReader::Ring *AsyncBlockReader::setupRing(unsigned entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+    {
+        return nullptr; // not supported or not permitted, use the thread pool
+    }
+
+    Ring *ring = new Ring();
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap)
+    {
+        ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+    }
+
+    ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cqRing = singleMap ? ring->sqRing
+                             : mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        close(fd);
+        delete ring;
+        return nullptr;
+    }
+
+    char *sq = static_cast<char *>(ring->sqRing);
+    char *cq = static_cast<char *>(ring->cqRing);
+    ring->sqes = static_cast<io_uring_sqe *>(sqes);
+    ring->sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    ring->sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    ring->cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return ring;
+}
+
+void AsyncBlockReader::teardownRing(Ring *ring)
+{
+    if (ring == nullptr)
+    {
+        return;
+    }
+    munmap(ring->sqes, ring->entries * sizeof(io_uring_sqe));
+    if (ring->cqRing != ring->sqRing)
+    {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    munmap(ring->sqRing, ring->sqRingSize);
+    close(ring->fd);
+    delete ring;
+}
+
+// If io_uring_enter fails, the reads already taken by the kernel still point at the local
+// buffers, so they are all reaped before returning. The ring is then given up and the
+// blocks not yet taken are read through the thread pool.
+bool AsyncBlockReader::readWithIoUring(const std::vector<uint32_t> &blockIds, const std::function<void(uint32_t, const Block &)> &onBlock)
+{
+    unsigned depth = std::min<unsigned>(ring->entries, (unsigned)queueDepth);
+    std::vector<unsigned char> buffers(depth * BLOCK_SIZE);
+    std::vector<iovec> iovecs(depth);
+    std::vector<uint32_t> slotBlock(depth);
+    std::vector<unsigned> freeSlots;
+    for (unsigned i = 0; i < depth; i++)
+    {
+        iovecs[i].iov_base = &buffers[i * BLOCK_SIZE];
+        iovecs[i].iov_len = BLOCK_SIZE;
+        freeSlots.push_back(i);
+    }
+
+    size_t submitted = 0, completed = 0;
+    bool allRead = true;
+    Block block;
+
+    // Deliver every completed block
+    auto reap = [&]() {
+        unsigned head = *ring->cqHead;
+        while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+        {
+            const io_uring_cqe &cqe = ring->cqes[head & *ring->cqMask];
+            unsigned slot = (unsigned)cqe.user_data;
+            if (cqe.res < 0)
+            {
+                std::cerr << "Failed to read block " << slotBlock[slot] << ": " << std::strerror(-cqe.res) << std::endl;
+                block.records.clear();
+                allRead = false;
+            }
+            else
+            {
+                BlockFile::decodeBlock(&buffers[slot * BLOCK_SIZE], (size_t)cqe.res, block);
+            }
+            head++;
+            __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+            onBlock(slotBlock[slot], block);
+            freeSlots.push_back(slot);
+            completed++;
+        }
+    };
+
+    while (completed < blockIds.size())
+    {
+        // Fill the submission queue up to the queue depth
+        unsigned tail = *ring->sqTail;
+        while (submitted < blockIds.size() && !freeSlots.empty())
+        {
+            unsigned slot = freeSlots.back();
+            freeSlots.pop_back();
+            unsigned index = tail & *ring->sqMask;
+            io_uring_sqe *sqe = &ring->sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = file.descriptor();
+            sqe->off = (uint64_t)blockIds[submitted] * BLOCK_SIZE;
+            sqe->addr = (uint64_t)(uintptr_t)&iovecs[slot];
+            sqe->len = 1;
+            sqe->user_data = slot;
+            ring->sqArray[index] = index;
+            slotBlock[slot] = blockIds[submitted];
+            tail++;
+            submitted++;
+        }
+        __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+        unsigned unconsumed = tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE); // queued but not yet taken by the kernel
+        long ret = syscall(__NR_io_uring_enter, ring->fd, unconsumed, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            std::cerr << "io_uring_enter failed: " << std::strerror(errno) << ", reading the rest with the thread pool" << std::endl;
+            // The kernel only looks at the submission queue inside io_uring_enter, so the
+            // entries it has not taken can be withdrawn and read later
+            unsigned sqHead = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+            submitted -= tail - sqHead;
+            __atomic_store_n(ring->sqTail, sqHead, __ATOMIC_RELEASE);
+            while (completed < submitted)
+            {
+                reap();
+                if (completed < submitted && syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            teardownRing(ring);
+            ring = nullptr;
+            std::vector<uint32_t> rest(blockIds.begin() + submitted, blockIds.end());
+            return readWithThreads(rest, onBlock) && allRead;
+        }
+        reap();
+    }
+    return allRead;
+}
+#else
+AsyncBlockReader::Ring *AsyncBlockReader::setupRing(unsigned)
+{
+    return nullptr;
+}
+
+void AsyncBlockReader::teardownRing(Ring *)
+{
+}
+
+bool AsyncBlockReader::readWithIoUring(const std::vector<uint32_t> &blockIds, const std::function<void(uint32_t, const Block &)> &onBlock)
+{
+    return readWithThreads(blockIds, onBlock);
+}
+#endif
+
+bool AsyncBlockReader::readWithThreads(const std::vector<uint32_t> &blockIds, const std::function<void(uint32_t, const Block &)> &onBlock)
+{
+    if (blockIds.empty())
+    {
+        return true;
+    }
+    std::mutex mtx;
+    std::condition_variable readyCv, spaceCv;
+    std::deque<std::pair<uint32_t, Block>> done;
+    size_t nextIndex = 0;
+    size_t pending = 0; // reads claimed by a worker but not yet consumed
+    bool allRead = true;
+
+    auto worker = [&]() {
+        while (true)
+        {
+            size_t i;
+            {
+                // Bound the reads in flight plus completed blocks waiting for the consumer
+                std::unique_lock<std::mutex> lock(mtx);
+                spaceCv.wait(lock, [&]() { return pending < (size_t)queueDepth || nextIndex >= blockIds.size(); });
+                if (nextIndex >= blockIds.size())
+                    return;
+                i = nextIndex++;
+                pending++;
+            }
+            Block block;
+            bool read = file.readBlock(blockIds[i], block);
+            std::lock_guard<std::mutex> lock(mtx);
+            allRead = allRead && read;
+            done.push_back(std::make_pair(blockIds[i], block));
+            readyCv.notify_one();
+        }
+    };
+
+    size_t workers = std::min(blockIds.size(), (size_t)queueDepth);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; i++)
+    {
+        threads.push_back(std::thread(worker));
+    }
+
+    for (size_t delivered = 0; delivered < blockIds.size(); delivered++)
+    {
+        std::pair<uint32_t, Block> next;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            readyCv.wait(lock, [&]() { return !done.empty(); });
+            next = done.front();
+            done.pop_front();
+            pending--;
+        }
+        spaceCv.notify_one();
+        onBlock(next.first, next.second);
+    }
+    spaceCv.notify_all();
+
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    return allRead;
+}
+
+void experimentAsyncPrefetch(BPlusTree &tree, SimulatedDisk &disk)
+{
+    const std::string filename = "Data.dat";
+    disk.writeToDisk(filename);
+    BlockFile file(filename);
+    if (!file.isOpen())
+    {
+        return;
+    }
+    AsyncBlockReader asyncReader(file, 32);
+    AsyncBlockReader threadReader(file, 32, false);
+
+    const int ranges[3][2] = {{30000, 40000}, {1000, 10000}, {100, 1000}};
+    for (const auto &range : ranges)
+    {
+        int minVotes = range[0], maxVotes = range[1];
+
+        // Block ids the range scan needs, in file order
+        std::vector<uint32_t> blockIds;
+        for (unsigned char *recordPtr : tree.rangeSearch(minVotes, maxVotes))
+        {
+            long blockId = disk.blockIdOf(recordPtr);
+            if (blockId >= 0)
+                blockIds.push_back((uint32_t)blockId);
+        }
+        std::sort(blockIds.begin(), blockIds.end());
+        blockIds.erase(std::unique(blockIds.begin(), blockIds.end()), blockIds.end());
+
+        int matching[3] = {0, 0, 0};
+        bool complete[3] = {true, true, true};
+        double elapsed[3];
+        auto countMatches = [&](int run) {
+            return [&, run](uint32_t, const Block &block) {
+                for (const Record &record : block.records)
+                {
+                    if (record.numVotes >= minVotes && record.numVotes <= maxVotes)
+                        matching[run]++;
+                }
+            };
+        };
+
+        // Synchronous: one pread per block, in order
+        file.dropCache();
+        auto start = std::chrono::high_resolution_clock::now();
+        std::function<void(uint32_t, const Block &)> syncVisit = countMatches(0);
+        for (uint32_t blockId : blockIds)
+        {
+            Block block;
+            complete[0] = file.readBlock(blockId, block) && complete[0];
+            syncVisit(blockId, block);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        elapsed[0] = std::chrono::duration<double, std::milli>(end - start).count();
+
+        AsyncBlockReader *readers[2] = {&asyncReader, &threadReader};
+        bool ringBefore = asyncReader.usingIoUring();
+        for (int run = 1; run <= 2; run++)
+        {
+            file.dropCache();
+            start = std::chrono::high_resolution_clock::now();
+            complete[run] = readers[run - 1]->readBlocks(blockIds, countMatches(run));
+            end = std::chrono::high_resolution_clock::now();
+            elapsed[run] = std::chrono::duration<double, std::milli>(end - start).count();
+        }
+        std::string asyncLabel = !ringBefore ? "pread pool (no io_uring)"
+                                 : asyncReader.usingIoUring() ? "io_uring, queue depth 32" : "io_uring, fell back to pread";
+
+        printHeader("Range " + std::to_string(minVotes) + " - " + std::to_string(maxVotes) + " over " + filename);
+        printKeyValue("Data blocks read", std::to_string(blockIds.size()));
+        printKeyValue("Matching records", std::to_string(matching[0]));
+        printKeyValue("Synchronous pread", std::to_string(elapsed[0]) + " milliseconds" + (complete[0] ? "" : " (some blocks unreadable)"));
+        printKeyValue(asyncLabel, std::to_string(elapsed[1]) + " milliseconds (" + std::to_string(matching[1]) + " records" +
+                                      (complete[1] ? ")" : ", some blocks unreadable)"));
+        printKeyValue("pread pool, 32 threads", std::to_string(elapsed[2]) + " milliseconds (" + std::to_string(matching[2]) + " records" +
+                                                    (complete[2] ? ")" : ", some blocks unreadable)"));
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef BLOCKREADER_H
+#define BLOCKREADER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "Storage.h"
+
+// Data file written by SimulatedDisk::writeToDisk, read one BLOCK_SIZE block at a time
+class BlockFile
+{
+    std::string filename;
+    int fd;
+
+public:
+    BlockFile(const std::string &filename);
+    ~BlockFile();
+    bool isOpen() const;
+    int descriptor() const;
+    size_t totalBlocks() const;
+    bool readBlock(uint32_t blockId, Block &block) const;
+    void dropCache() const;
+    static void decodeBlock(const unsigned char *buffer, size_t length, Block &block);
+};
+
+// Reads a list of blocks with at most queueDepth reads outstanding and hands
+// every block to the callback as soon as it completes, in completion order.
+// Reads are issued through io_uring where the kernel allows it, otherwise
+// through a pool of threads doing pread. If io_uring fails part way through,
+// the rest of the blocks are read by the thread pool and usingIoUring()
+// turns false for the reads after.
+class AsyncBlockReader
+{
+    struct Ring;
+
+    const BlockFile &file;
+    int queueDepth;
+    Ring *ring;
+
+    static Ring *setupRing(unsigned entries);
+    static void teardownRing(Ring *ring);
+    bool readWithIoUring(const std::vector<uint32_t> &blockIds, const std::function<void(uint32_t, const Block &)> &onBlock);
+    bool readWithThreads(const std::vector<uint32_t> &blockIds, const std::function<void(uint32_t, const Block &)> &onBlock);
+
+public:
+    AsyncBlockReader(const BlockFile &file, int queueDepth = 32, bool allowIoUring = true);
+    ~AsyncBlockReader();
+    bool usingIoUring() const;
+    // False if some block could not be read, it is then handed to onBlock empty
+    bool readBlocks(const std::vector<uint32_t> &blockIds, const std::function<void(uint32_t, const Block &)> &onBlock);
+};
+
+class BPlusTree; // forward declare
+
+// Range queries over Data.dat with cold cache: one pread per block versus batched asynchronous reads
+void experimentAsyncPrefetch(BPlusTree &tree, SimulatedDisk &disk);
+
+#endif // BLOCKREADER_H
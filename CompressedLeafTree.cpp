@@ -0,0 +1,434 @@
+#include "CompressedLeafTree.h"
+#include "BPlusTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Leaf block layout
+static const int LEAF_BASE = 0;        // int, smallest key of the leaf
+static const int LEAF_COUNT = 4;       // unsigned char, number of keys
+static const int LEAF_DELTA_BYTES = 5; // unsigned char, 1, 2 or 4
+static const int LEAF_NEXT = 8;        // next leaf in key order
+static const int LEAF_HEADER = 16;     // deltas start here, posting pointers follow them
+
+static int deltaBytesFor(uint32_t delta)
+{
+    return delta <= 0xFF ? 1 : (delta <= 0xFFFF ? 2 : 4);
+}
+
+static int packedCount(const unsigned char *leaf)
+{
+    return leaf[LEAF_COUNT];
+}
+
+static int packedDeltaBytes(const unsigned char *leaf)
+{
+    return leaf[LEAF_DELTA_BYTES];
+}
+
+static int packedBase(const unsigned char *leaf)
+{
+    int base;
+    std::memcpy(&base, leaf + LEAF_BASE, sizeof(base));
+    return base;
+}
+
+static unsigned char *packedNext(const unsigned char *leaf)
+{
+    unsigned char *next;
+    std::memcpy(&next, leaf + LEAF_NEXT, sizeof(next));
+    return next;
+}
+
+static int packedKey(const unsigned char *leaf, int i)
+{
+    uint32_t delta = 0;
+    std::memcpy(&delta, leaf + LEAF_HEADER + i * packedDeltaBytes(leaf), packedDeltaBytes(leaf)); // little-endian
+    return (int)((uint32_t)packedBase(leaf) + delta);
+}
+
+static std::vector<unsigned char *> *packedPosting(const unsigned char *leaf, int i)
+{
+    std::vector<unsigned char *> *posting;
+    std::memcpy(&posting, leaf + LEAF_HEADER + packedCount(leaf) * packedDeltaBytes(leaf) + i * sizeof(posting), sizeof(posting));
+    return posting;
+}
+
+CompressedLeafTree::CompressedLeafTree()
+    : internalRoot(nullptr), leafRoot(nullptr), nodes(0), levels(0), leaves(0), numKeys(0), simdSearch(true) {}
+
+CompressedLeafTree::~CompressedLeafTree()
+{
+    deallocate(internalRoot);
+    delete[] leafRoot;
+    for (std::vector<unsigned char *> *posting : postings)
+    {
+        delete posting;
+    }
+}
+
+void CompressedLeafTree::deallocate(PackedInternalNode *node)
+{
+    if (node == nullptr)
+        return;
+    for (PackedInternalNode *child : node->children)
+    {
+        deallocate(child);
+    }
+    for (unsigned char *leaf : node->leaves)
+    {
+        delete[] leaf;
+    }
+    delete node;
+}
+
+bool CompressedLeafTree::bulkLoad(const std::function<bool(int &key, unsigned char *&record)> &next)
+{
+    if (internalRoot != nullptr || leafRoot != nullptr)
+    {
+        cerr << "bulkLoad needs an empty tree" << endl;
+        return false;
+    }
+
+    std::vector<unsigned char *> level;
+    std::vector<int> lowKeys; // smallest key under each node of the level
+    std::vector<int> pendingKeys;
+    std::vector<std::vector<unsigned char *> *> pendingPostings;
+    bool ordered = true;
+
+    // Writes the pending keys out as one leaf block
+    auto flushLeaf = [&]() {
+        int count = (int)pendingKeys.size();
+        int base = pendingKeys[0];
+        int deltaBytes = deltaBytesFor((uint32_t)pendingKeys.back() - (uint32_t)base);
+        unsigned char *leaf = new unsigned char[BLOCK_SIZE]();
+        std::memcpy(leaf + LEAF_BASE, &base, sizeof(base));
+        leaf[LEAF_COUNT] = (unsigned char)count;
+        leaf[LEAF_DELTA_BYTES] = (unsigned char)deltaBytes;
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t delta = (uint32_t)pendingKeys[i] - (uint32_t)base;
+            std::memcpy(leaf + LEAF_HEADER + i * deltaBytes, &delta, deltaBytes);
+            std::memcpy(leaf + LEAF_HEADER + count * deltaBytes + i * sizeof(pendingPostings[i]), &pendingPostings[i], sizeof(pendingPostings[i]));
+        }
+        if (!level.empty())
+            std::memcpy(level.back() + LEAF_NEXT, &leaf, sizeof(leaf));
+        level.push_back(leaf);
+        lowKeys.push_back(base);
+        pendingKeys.clear();
+        pendingPostings.clear();
+        ++leaves;
+        ++nodes;
+    };
+
+    int key;
+    unsigned char *record;
+    while (next(key, record))
+    {
+        if (!pendingKeys.empty() && key == pendingKeys.back())
+        {
+            pendingPostings.back()->push_back(record);
+            continue;
+        }
+        if (!pendingKeys.empty() && key < pendingKeys.back())
+        {
+            cerr << "bulkLoad keys out of order: " << key << " after " << pendingKeys.back() << endl;
+            ordered = false;
+            break;
+        }
+        // Start a new leaf once the key no longer fits at the width its delta needs
+        if (!pendingKeys.empty())
+        {
+            int count = (int)pendingKeys.size() + 1;
+            int deltaBytes = deltaBytesFor((uint32_t)key - (uint32_t)pendingKeys[0]);
+            if (count > 255 || LEAF_HEADER + count * (deltaBytes + (int)sizeof(unsigned char *)) > BLOCK_SIZE)
+                flushLeaf();
+        }
+        postings.push_back(new std::vector<unsigned char *>(1, record));
+        pendingKeys.push_back(key);
+        pendingPostings.push_back(postings.back());
+        ++numKeys;
+    }
+    if (!pendingKeys.empty())
+        flushLeaf();
+    if (level.empty())
+        return ordered;
+    levels = 1;
+    if (level.size() == 1)
+    {
+        leafRoot = level[0];
+        return ordered;
+    }
+
+    // Internal levels as in BPlusTree::bulkLoad: up to N + 1 children, the last two nodes evened out
+    std::vector<PackedInternalNode *> internalLevel;
+    size_t count = level.size();
+    while (count > 1)
+    {
+        std::vector<PackedInternalNode *> parents;
+        std::vector<int> parentLowKeys;
+        size_t minChildren = (N + 2) / 2;
+        size_t first = 0;
+        while (first < count)
+        {
+            size_t children = std::min((size_t)N + 1, count - first);
+            size_t remaining = count - first - children;
+            if (remaining > 0 && remaining < minChildren)
+                children = (children + remaining + 1) / 2; // share with the last node
+            PackedInternalNode *parent = new PackedInternalNode();
+            for (size_t c = 0; c < children; c++)
+            {
+                if (internalLevel.empty())
+                    parent->leaves.push_back(level[first + c]);
+                else
+                    parent->children.push_back(internalLevel[first + c]);
+                if (c > 0)
+                    parent->keys.push_back(lowKeys[first + c]);
+            }
+            parents.push_back(parent);
+            parentLowKeys.push_back(lowKeys[first]);
+            ++nodes;
+            first += children;
+        }
+        internalLevel.swap(parents);
+        lowKeys.swap(parentLowKeys);
+        count = internalLevel.size();
+        ++levels;
+    }
+    internalRoot = internalLevel[0];
+    return ordered;
+}
+
+// Position of the first key >= key in the leaf
+int CompressedLeafTree::leafLowerBound(const unsigned char *leaf, int key, bool simd)
+{
+    int count = packedCount(leaf);
+    int deltaBytes = packedDeltaBytes(leaf);
+    int base = packedBase(leaf);
+    if (key <= base)
+        return 0;
+    uint32_t target = (uint32_t)key - (uint32_t)base;
+    if (deltaBytes < 4 && target > (1u << (8 * deltaBytes)) - 1)
+        return count; // larger than any delta the leaf can hold
+#ifdef __SSE2__
+    if (simd)
+    {
+        // SSE2 only compares signed lanes, so both sides are shifted by flipping the top bit
+        __m128i flip, needle;
+        if (deltaBytes == 1)
+        {
+            flip = _mm_set1_epi8((char)0x80);
+            needle = _mm_set1_epi8((char)(target ^ 0x80));
+        }
+        else if (deltaBytes == 2)
+        {
+            flip = _mm_set1_epi16((short)0x8000);
+            needle = _mm_set1_epi16((short)(target ^ 0x8000));
+        }
+        else
+        {
+            flip = _mm_set1_epi32((int)0x80000000);
+            needle = _mm_set1_epi32((int)(target ^ 0x80000000));
+        }
+        // The deltas are sorted, so the number of deltas below the target is the position.
+        // Loads may run past the deltas, still inside the block; those lanes are masked off.
+        int position = 0;
+        int totalBytes = count * deltaBytes;
+        for (int offset = 0; offset < totalBytes; offset += 16)
+        {
+            __m128i deltas = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(leaf + LEAF_HEADER + offset)), flip);
+            __m128i less;
+            if (deltaBytes == 1)
+                less = _mm_cmplt_epi8(deltas, needle);
+            else if (deltaBytes == 2)
+                less = _mm_cmplt_epi16(deltas, needle);
+            else
+                less = _mm_cmplt_epi32(deltas, needle);
+            int validBytes = std::min(16, totalBytes - offset);
+            unsigned mask = (unsigned)_mm_movemask_epi8(less) & ((1u << validBytes) - 1);
+            position += __builtin_popcount(mask) / deltaBytes;
+        }
+        return position;
+    }
+#else
+    (void)simd;
+#endif
+    int position = 0;
+    while (position < count && packedKey(leaf, position) < key)
+    {
+        position++;
+    }
+    return position;
+}
+
+const unsigned char *CompressedLeafTree::findLeaf(int key) const
+{
+    if (leafRoot != nullptr)
+        return leafRoot;
+    const PackedInternalNode *node = internalRoot;
+    while (node != nullptr)
+    {
+        size_t child = std::upper_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin();
+        if (!node->leaves.empty())
+            return node->leaves[child];
+        node = node->children[child];
+    }
+    return nullptr;
+}
+
+const std::vector<unsigned char *> *CompressedLeafTree::lookup(int key) const
+{
+    const unsigned char *leaf = findLeaf(key);
+    if (leaf == nullptr)
+        return nullptr;
+    int position = leafLowerBound(leaf, key, simdSearch);
+    if (position == packedCount(leaf) || packedKey(leaf, position) != key)
+        return nullptr;
+    return packedPosting(leaf, position);
+}
+
+std::vector<unsigned char *> CompressedLeafTree::rangeSearch(int minKey, int maxKey) const
+{
+    std::vector<unsigned char *> result;
+    const unsigned char *leaf = findLeaf(minKey);
+    int position = leaf != nullptr ? leafLowerBound(leaf, minKey, simdSearch) : 0;
+    while (leaf != nullptr)
+    {
+        for (int count = packedCount(leaf); position < count; position++)
+        {
+            if (packedKey(leaf, position) > maxKey)
+                return result;
+            const std::vector<unsigned char *> &posting = *packedPosting(leaf, position);
+            result.insert(result.end(), posting.begin(), posting.end());
+        }
+        leaf = packedNext(leaf);
+        position = 0;
+    }
+    return result;
+}
+
+void CompressedLeafTree::setSimdSearch(bool on)
+{
+    simdSearch = on;
+}
+
+int CompressedLeafTree::nodeCount() const
+{
+    return nodes;
+}
+
+int CompressedLeafTree::height() const
+{
+    return levels;
+}
+
+int CompressedLeafTree::leafCount() const
+{
+    return leaves;
+}
+
+int CompressedLeafTree::keyCount() const
+{
+    return numKeys;
+}
+
+double CompressedLeafTree::averageLeafKeys() const
+{
+    return leaves == 0 ? 0.0 : (double)numKeys / leaves;
+}
+
+void experimentCompressedLeaves(const SimulatedDisk &disk)
+{
+    if (disk.totalRecords() == 0)
+    {
+        std::cout << "The disk is empty, run experiment 1 first" << std::endl;
+        return;
+    }
+
+    std::vector<std::pair<int, unsigned char *>> entries = disk.numVotesEntries();
+
+    // Both trees are bulk-loaded with full leaves, so only the leaf format differs
+    BPlusTree plain;
+    plain.setVerbose(false);
+    CompressedLeafTree compressed;
+    size_t next = 0;
+    auto feed = [&](int &key, unsigned char *&record) {
+        if (next == entries.size())
+            return false;
+        key = entries[next].first;
+        record = entries[next].second;
+        next++;
+        return true;
+    };
+    plain.bulkLoad(feed);
+    next = 0;
+    compressed.bulkLoad(feed);
+
+    std::vector<int> probes;
+    for (const std::pair<int, unsigned char *> &entry : entries)
+    {
+        if (probes.empty() || probes.back() != entry.first)
+            probes.push_back(entry.first);
+    }
+    std::mt19937 rng(3020);
+    std::shuffle(probes.begin(), probes.end(), rng);
+    if (probes.size() > 100000)
+        probes.resize(100000);
+
+    printHeader("Uncompressed leaves (B+ tree)");
+    printKeyValue("Parameter N", std::to_string(N));
+    printKeyValue("Number of nodes", std::to_string(plain.nodeCount()));
+    printKeyValue("Number of levels", std::to_string(plain.height()));
+    printKeyValue("Number of leaves", std::to_string(plain.leafCount()));
+    printKeyValue("Average keys per leaf", std::to_string(plain.leafCount() == 0 ? 0.0 : (double)plain.keyCount() / plain.leafCount()));
+    // Both sides add up the record addresses, so every record of every posting list is read
+    uintptr_t plainChecksum = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int key : probes)
+    {
+        for (PostingIterator it = plain.lookup(key); it.valid(); ++it)
+        {
+            plainChecksum += reinterpret_cast<uintptr_t>(*it);
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> duration = end - start;
+    printKeyValue("Lookup latency", std::to_string(duration.count() / probes.size()) + " ns");
+
+    printHeader("Frame-of-reference leaves");
+    printKeyValue("Number of nodes", std::to_string(compressed.nodeCount()));
+    printKeyValue("Number of levels", std::to_string(compressed.height()));
+    printKeyValue("Number of leaves", std::to_string(compressed.leafCount()));
+    printKeyValue("Average keys per leaf", std::to_string(compressed.averageLeafKeys()));
+    const char *searchNames[2] = {"Lookup latency, scalar", "Lookup latency, SSE2"};
+    bool sameResults = true;
+    for (int simd = 0; simd < 2; simd++)
+    {
+        compressed.setSimdSearch(simd == 1);
+        uintptr_t checksum = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (int key : probes)
+        {
+            const std::vector<unsigned char *> *posting = compressed.lookup(key);
+            if (posting == nullptr)
+                continue;
+            for (unsigned char *record : *posting)
+            {
+                checksum += reinterpret_cast<uintptr_t>(record);
+            }
+        }
+        end = std::chrono::high_resolution_clock::now();
+        duration = end - start;
+        sameResults = sameResults && checksum == plainChecksum;
+        printKeyValue(searchNames[simd], std::to_string(duration.count() / probes.size()) + " ns");
+    }
+#ifndef __SSE2__
+    printKeyValue("SSE2", "not available, both runs use the scalar decode");
+#endif
+    printKeyValue("Lookups", std::to_string(probes.size()));
+    printKeyValue("Same records as B+ tree", sameResults ? "yes" : "no");
+}
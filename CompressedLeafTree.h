@@ -0,0 +1,60 @@
+#ifndef COMPRESSEDLEAFTREE_H
+#define COMPRESSEDLEAFTREE_H
+
+#include <vector>
+#include <functional>
+#include "Storage.h"
+
+// Internal node of the compressed-leaf tree, laid out like the B+ tree's Node:
+// up to N keys and N + 1 children, which are either internal nodes or leaf blocks
+struct PackedInternalNode
+{
+    std::vector<int> keys;
+    std::vector<PackedInternalNode *> children;
+    std::vector<unsigned char *> leaves;
+};
+
+// Read-only numVotes index whose leaves are frame-of-reference encoded.
+//
+// A leaf is one BLOCK_SIZE block: a 16-byte header (base key, key count, bytes
+// per delta and the next leaf pointer), then every key as an unsigned delta from
+// the base in 1, 2 or 4 bytes, whichever fits the largest delta of the leaf, then
+// one posting list pointer per key. Keys that sit close together take one byte
+// instead of four, so a leaf holds up to 20 keys against N = 14 in the B+ tree.
+//
+// Deltas are byte-aligned so that with SSE2 a search compares 16, 8 or 4 of them
+// with one instruction and counts the smaller ones, which gives the lower bound.
+class CompressedLeafTree
+{
+    PackedInternalNode *internalRoot;
+    unsigned char *leafRoot; // root when the tree is a single leaf
+    std::vector<std::vector<unsigned char *> *> postings;
+    int nodes;
+    int levels;
+    int leaves;
+    int numKeys;
+    bool simdSearch;
+
+    static int leafLowerBound(const unsigned char *leaf, int key, bool simd);
+    const unsigned char *findLeaf(int key) const;
+    void deallocate(PackedInternalNode *node);
+
+public:
+    CompressedLeafTree();
+    ~CompressedLeafTree();
+    // Builds the tree from keys in ascending order, packing each leaf as full as its deltas allow
+    bool bulkLoad(const std::function<bool(int &key, unsigned char *&record)> &next);
+    const std::vector<unsigned char *> *lookup(int key) const;
+    std::vector<unsigned char *> rangeSearch(int minKey, int maxKey) const;
+    void setSimdSearch(bool on);
+    int nodeCount() const;
+    int height() const;
+    int leafCount() const;
+    int keyCount() const;
+    double averageLeafKeys() const;
+};
+
+// Node count, levels and lookup latency of the compressed-leaf tree against the bulk-loaded B+ tree
+void experimentCompressedLeaves(const SimulatedDisk &disk);
+
+#endif // COMPRESSEDLEAFTREE_H
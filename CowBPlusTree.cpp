@@ -0,0 +1,568 @@
+#include "CowBPlusTree.h"
+#include "Storage.h"
+#include "Instrumentation.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+CowBPlusTree::Snapshot::Snapshot(const CowBPlusTree *tree, int slot, const CowNode *root)
+    : tree(tree), slot(slot), root(root) {}
+
+CowBPlusTree::Snapshot::Snapshot(Snapshot &&other)
+    : tree(other.tree), slot(other.slot), root(other.root)
+{
+    other.tree = nullptr;
+}
+
+CowBPlusTree::Snapshot::~Snapshot()
+{
+    if (tree != nullptr)
+        tree->readerEpochs[slot].store(0);
+}
+
+std::vector<unsigned char *> CowBPlusTree::Snapshot::search(int key) const
+{
+    std::vector<unsigned char *> result;
+    const CowNode *cursor = root;
+    if (cursor == nullptr)
+        return result;
+    while (!cursor->isLeaf)
+    {
+        size_t child = std::upper_bound(cursor->keys.begin(), cursor->keys.end(), key) - cursor->keys.begin();
+        cursor = cursor->children[child];
+    }
+    std::vector<int>::const_iterator it = std::lower_bound(cursor->keys.begin(), cursor->keys.end(), key);
+    if (it != cursor->keys.end() && *it == key)
+    {
+        const Posting &posting = *cursor->postings[it - cursor->keys.begin()];
+        result.assign(posting.begin(), posting.end());
+    }
+    return result;
+}
+
+// In-order walk of the subtrees that can hold keys in [minKey, maxKey]
+static void collectRange(const CowNode *node, int minKey, int maxKey, std::vector<unsigned char *> &result)
+{
+    if (node->isLeaf)
+    {
+        size_t i = std::lower_bound(node->keys.begin(), node->keys.end(), minKey) - node->keys.begin();
+        for (; i < node->keys.size() && node->keys[i] <= maxKey; i++)
+        {
+            const Posting &posting = *node->postings[i];
+            result.insert(result.end(), posting.begin(), posting.end());
+        }
+        return;
+    }
+    size_t first = std::upper_bound(node->keys.begin(), node->keys.end(), minKey) - node->keys.begin();
+    size_t last = std::upper_bound(node->keys.begin(), node->keys.end(), maxKey) - node->keys.begin();
+    for (size_t child = first; child <= last; child++)
+    {
+        collectRange(node->children[child], minKey, maxKey, result);
+    }
+}
+
+std::vector<unsigned char *> CowBPlusTree::Snapshot::rangeSearch(int minKey, int maxKey) const
+{
+    std::vector<unsigned char *> result;
+    if (root != nullptr && minKey <= maxKey)
+        collectRange(root, minKey, maxKey, result);
+    return result;
+}
+
+CowBPlusTree::CowBPlusTree()
+    : root(nullptr), epoch(1), workingRoot(nullptr), writeVersion(0), inBatch(false), reclaimed(0)
+{
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        readerEpochs[i].store(0);
+    }
+}
+
+CowBPlusTree::~CowBPlusTree()
+{
+    // Any snapshot must be gone by now, so every retired node can go too
+    commitBatch();
+    for (const std::pair<uint64_t, CowNode *> &entry : retired)
+    {
+        delete entry.second;
+    }
+    destroy(root.load());
+}
+
+// Frees a whole version; only valid when no other version shares its nodes
+void CowBPlusTree::destroy(CowNode *node)
+{
+    if (node == nullptr)
+        return;
+    if (!node->isLeaf)
+    {
+        for (CowNode *child : node->children)
+        {
+            destroy(child);
+        }
+    }
+    delete node;
+}
+
+// Builds the tree bottom-up from entries sorted on key, with full nodes
+void CowBPlusTree::load(const std::vector<std::pair<int, unsigned char *>> &sortedEntries)
+{
+    destroy(root.load());
+    root.store(nullptr);
+
+    std::vector<CowNode *> level;
+    std::vector<int> lowKeys; // smallest key under each node of the level
+    size_t i = 0;
+    while (i < sortedEntries.size())
+    {
+        CowNode *leaf = new CowNode();
+        leaf->isLeaf = true;
+        leaf->version = 0;
+        lowKeys.push_back(sortedEntries[i].first);
+        while (i < sortedEntries.size() && (int)leaf->keys.size() < N)
+        {
+            std::shared_ptr<Posting> posting = std::make_shared<Posting>();
+            int key = sortedEntries[i].first;
+            for (; i < sortedEntries.size() && sortedEntries[i].first == key; i++)
+            {
+                posting->push_back(sortedEntries[i].second);
+            }
+            leaf->keys.push_back(key);
+            leaf->postings.push_back(posting);
+        }
+        level.push_back(leaf);
+    }
+
+    while (level.size() > 1)
+    {
+        std::vector<CowNode *> parents;
+        std::vector<int> parentLowKeys;
+        size_t first = 0;
+        while (first < level.size())
+        {
+            size_t last = std::min(level.size(), first + N + 1);
+            // Do not leave a single child for the last parent
+            if (level.size() - last == 1)
+                last--;
+            CowNode *parent = new CowNode();
+            parent->isLeaf = false;
+            parent->version = 0;
+            for (size_t child = first; child < last; child++)
+            {
+                if (child > first)
+                    parent->keys.push_back(lowKeys[child]);
+                parent->children.push_back(level[child]);
+            }
+            parents.push_back(parent);
+            parentLowKeys.push_back(lowKeys[first]);
+            first = last;
+        }
+        level.swap(parents);
+        lowKeys.swap(parentLowKeys);
+    }
+    root.store(level.empty() ? nullptr : level[0]);
+}
+
+void CowBPlusTree::beginBatch()
+{
+    if (inBatch)
+        return;
+    inBatch = true;
+    writeVersion++;
+    workingRoot = root.load();
+}
+
+// The node itself if this batch created it, otherwise a private copy of it
+CowNode *CowBPlusTree::writable(CowNode *node)
+{
+    if (node->version == writeVersion)
+        return node;
+    CowNode *copy = new CowNode(*node);
+    copy->version = writeVersion;
+    replacedInBatch.push_back(node);
+    return copy;
+}
+
+// Drops a node that is no longer part of the working version
+void CowBPlusTree::release(CowNode *node)
+{
+    if (node->version == writeVersion)
+        delete node; // never published
+    else
+        replacedInBatch.push_back(node);
+}
+
+// Returns the writable copy of node with the key added. When the copy overflows it is
+// split, right is set to the new right sibling and upKey to the separator for the parent.
+CowNode *CowBPlusTree::insertInto(CowNode *node, int key, unsigned char *record, int &upKey, CowNode *&right)
+{
+    right = nullptr;
+    if (node->isLeaf)
+    {
+        CowNode *leaf = writable(node);
+        size_t i = std::lower_bound(leaf->keys.begin(), leaf->keys.end(), key) - leaf->keys.begin();
+        if (i < leaf->keys.size() && leaf->keys[i] == key)
+        {
+            // Published postings are shared with older versions, so the append goes to a copy
+            std::shared_ptr<Posting> posting = std::make_shared<Posting>(*leaf->postings[i]);
+            posting->push_back(record);
+            leaf->postings[i] = posting;
+            return leaf;
+        }
+        leaf->keys.insert(leaf->keys.begin() + i, key);
+        leaf->postings.insert(leaf->postings.begin() + i, std::make_shared<Posting>(1, record));
+        if ((int)leaf->keys.size() > N)
+        {
+            size_t half = leaf->keys.size() / 2;
+            right = new CowNode();
+            right->isLeaf = true;
+            right->version = writeVersion;
+            right->keys.assign(leaf->keys.begin() + half, leaf->keys.end());
+            right->postings.assign(leaf->postings.begin() + half, leaf->postings.end());
+            leaf->keys.resize(half);
+            leaf->postings.resize(half);
+            upKey = right->keys[0];
+        }
+        return leaf;
+    }
+
+    size_t child = std::upper_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin();
+    int childUpKey = 0;
+    CowNode *childRight = nullptr;
+    CowNode *newChild = insertInto(node->children[child], key, record, childUpKey, childRight);
+    if (newChild == node->children[child] && childRight == nullptr)
+        return node; // the child was already private to this batch, so this node is too
+    CowNode *parent = writable(node);
+    parent->children[child] = newChild;
+    if (childRight == nullptr)
+        return parent;
+
+    parent->keys.insert(parent->keys.begin() + child, childUpKey);
+    parent->children.insert(parent->children.begin() + child + 1, childRight);
+    if ((int)parent->keys.size() > N)
+    {
+        // The middle key moves up and is kept in neither half
+        size_t middle = parent->keys.size() / 2;
+        right = new CowNode();
+        right->isLeaf = false;
+        right->version = writeVersion;
+        upKey = parent->keys[middle];
+        right->keys.assign(parent->keys.begin() + middle + 1, parent->keys.end());
+        right->children.assign(parent->children.begin() + middle + 1, parent->children.end());
+        parent->keys.resize(middle);
+        parent->children.resize(middle + 1);
+    }
+    return parent;
+}
+
+void CowBPlusTree::insert(int key, unsigned char *record)
+{
+    bool ownBatch = !inBatch;
+    beginBatch();
+    if (workingRoot == nullptr)
+    {
+        workingRoot = new CowNode();
+        workingRoot->isLeaf = true;
+        workingRoot->version = writeVersion;
+    }
+    int upKey = 0;
+    CowNode *right = nullptr;
+    workingRoot = insertInto(workingRoot, key, record, upKey, right);
+    if (right != nullptr)
+    {
+        CowNode *newRoot = new CowNode();
+        newRoot->isLeaf = false;
+        newRoot->version = writeVersion;
+        newRoot->keys.push_back(upKey);
+        newRoot->children.push_back(workingRoot);
+        newRoot->children.push_back(right);
+        workingRoot = newRoot;
+    }
+    if (ownBatch)
+        commitBatch();
+}
+
+// Returns the writable copy of node without the key, node itself if the key is not
+// there, or nullptr when the node ends up empty and has to be dropped by its parent
+CowNode *CowBPlusTree::eraseFrom(CowNode *node, int key, bool &found)
+{
+    if (node->isLeaf)
+    {
+        std::vector<int>::iterator it = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+        found = it != node->keys.end() && *it == key;
+        if (!found)
+            return node;
+        size_t i = it - node->keys.begin();
+        CowNode *leaf = writable(node);
+        leaf->keys.erase(leaf->keys.begin() + i);
+        leaf->postings.erase(leaf->postings.begin() + i);
+        if (leaf->keys.empty())
+        {
+            release(leaf);
+            return nullptr;
+        }
+        return leaf;
+    }
+
+    size_t child = std::upper_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin();
+    CowNode *newChild = eraseFrom(node->children[child], key, found);
+    if (!found || newChild == node->children[child])
+        return node;
+    CowNode *parent = writable(node);
+    if (newChild != nullptr)
+    {
+        parent->children[child] = newChild;
+        return parent;
+    }
+
+    // Drop the empty child with the separator on one side of it
+    parent->children.erase(parent->children.begin() + child);
+    if (!parent->keys.empty())
+        parent->keys.erase(parent->keys.begin() + (child > 0 ? child - 1 : 0));
+    if (parent->children.empty())
+    {
+        release(parent);
+        return nullptr;
+    }
+    return parent;
+}
+
+bool CowBPlusTree::erase(int key)
+{
+    bool ownBatch = !inBatch;
+    beginBatch();
+    bool found = false;
+    if (workingRoot != nullptr)
+    {
+        workingRoot = eraseFrom(workingRoot, key, found);
+        // A root with a single child gives up a level; every leaf stays at the same depth
+        while (workingRoot != nullptr && !workingRoot->isLeaf && workingRoot->children.size() == 1)
+        {
+            CowNode *onlyChild = workingRoot->children[0];
+            release(workingRoot);
+            workingRoot = onlyChild;
+        }
+    }
+    if (ownBatch)
+        commitBatch();
+    return found;
+}
+
+// Publishes the working version. Nodes it replaced are tagged with the new epoch.
+void CowBPlusTree::commitBatch()
+{
+    if (!inBatch)
+        return;
+    inBatch = false;
+    root.store(workingRoot);
+    uint64_t publishedEpoch = epoch.fetch_add(1) + 1;
+    for (CowNode *node : replacedInBatch)
+    {
+        retired.push_back(std::make_pair(publishedEpoch, node));
+    }
+    replacedInBatch.clear();
+    reclaim();
+}
+
+// A reader pinned at epoch e loaded a root published at e or later, so nodes retired
+// at or before the oldest pinned epoch can no longer be reached by any reader
+void CowBPlusTree::reclaim()
+{
+    uint64_t oldestPinned = UINT64_MAX;
+    for (int i = 0; i < MAX_READERS; i++)
+    {
+        uint64_t pinned = readerEpochs[i].load();
+        if (pinned != 0)
+            oldestPinned = std::min(oldestPinned, pinned);
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); i++)
+    {
+        if (retired[i].first <= oldestPinned)
+        {
+            delete retired[i].second;
+            reclaimed++;
+        }
+        else
+        {
+            retired[kept++] = retired[i];
+        }
+    }
+    retired.resize(kept);
+}
+
+// Pins the current epoch in a free reader slot before loading the root, so the
+// writer cannot free the version the reader is about to use. Never waits on the writer.
+CowBPlusTree::Snapshot CowBPlusTree::snapshot() const
+{
+    for (;;)
+    {
+        for (int i = 0; i < MAX_READERS; i++)
+        {
+            uint64_t expected = 0;
+            if (readerEpochs[i].compare_exchange_strong(expected, epoch.load()))
+                return Snapshot(this, i, root.load());
+        }
+        // More than MAX_READERS snapshots are open; wait for one of them to close
+        std::this_thread::yield();
+    }
+}
+
+size_t CowBPlusTree::retiredNodes() const
+{
+    return retired.size();
+}
+
+size_t CowBPlusTree::reclaimedNodes() const
+{
+    return reclaimed;
+}
+
+static void printLatency(const std::string &label, const LatencySummary &summary)
+{
+    printKeyValue(label, std::to_string(summary.count) + " queries, p50 " + std::to_string(summary.p50) +
+                             ", p99 " + std::to_string(summary.p99) + ", max " + std::to_string(summary.max) + " microseconds");
+}
+
+// Runs query on a reader thread, first alone and then while writer runs, and
+// returns the latencies of both phases
+static void measureReads(const std::function<void()> &query, const std::function<void()> &writer,
+                         std::vector<double> &quiet, std::vector<double> &busy)
+{
+    const int quietQueries = 2000;
+    std::atomic<bool> quietDone(false), writing(false), done(false);
+    std::thread reader([&]() {
+        int issued = 0;
+        while (!done.load())
+        {
+            bool duringWrites = writing.load();
+            if (!duringWrites && issued == quietQueries)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            query();
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::micro> duration = end - start;
+            (duringWrites ? busy : quiet).push_back(duration.count());
+            if (!duringWrites && ++issued == quietQueries)
+                quietDone.store(true);
+        }
+    });
+    while (!quietDone.load())
+    {
+        std::this_thread::yield();
+    }
+    writing.store(true);
+    writer();
+    done.store(true);
+    reader.join();
+}
+
+void experimentSnapshotReads(const SimulatedDisk &disk)
+{
+    if (disk.totalRecords() == 0)
+    {
+        std::cout << "The disk is empty, run experiment 1 first" << std::endl;
+        return;
+    }
+
+    std::vector<std::pair<int, unsigned char *>> entries = disk.numVotesEntries();
+
+    // As in experiment 5, delete whole keys, here every key up to 20,000 votes, in batches
+    const int deleteMax = 20000, watchMin = 15000;
+    const int queryMin = 30000, queryMax = 40000;
+    const size_t batchSize = 500;
+    std::vector<int> victims;
+    for (const std::pair<int, unsigned char *> &entry : entries)
+    {
+        if (entry.first <= deleteMax && (victims.empty() || victims.back() != entry.first))
+            victims.push_back(entry.first);
+    }
+
+    // Copy-on-write tree: the writer publishes one version per batch
+    CowBPlusTree cowTree;
+    cowTree.load(entries);
+    size_t expectedRange = cowTree.snapshot().rangeSearch(queryMin, queryMax).size();
+    bool consistent = true;
+    size_t lastRemaining = SIZE_MAX;
+    std::vector<double> cowQuiet, cowBusy;
+    measureReads(
+        [&]() {
+            CowBPlusTree::Snapshot snapshot = cowTree.snapshot();
+            // The queried range is never touched, and the deleted range only shrinks between snapshots
+            if (snapshot.rangeSearch(queryMin, queryMax).size() != expectedRange)
+                consistent = false;
+            size_t remaining = snapshot.rangeSearch(watchMin, deleteMax).size();
+            if (remaining > lastRemaining)
+                consistent = false;
+            lastRemaining = remaining;
+        },
+        [&]() {
+            for (size_t first = 0; first < victims.size(); first += batchSize)
+            {
+                cowTree.beginBatch();
+                for (size_t i = first; i < std::min(victims.size(), first + batchSize); i++)
+                {
+                    cowTree.erase(victims[i]);
+                }
+                cowTree.commitBatch();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        },
+        cowQuiet, cowBusy);
+    bool allDeleted = cowTree.snapshot().rangeSearch(INT_MIN, deleteMax).empty();
+
+    // Baseline: the regular tree, where a batch of deletes holds out every reader
+    BPlusTree lockedTree;
+    lockedTree.setVerbose(false);
+    size_t next = 0;
+    lockedTree.bulkLoad([&](int &key, unsigned char *&record) {
+        if (next == entries.size())
+            return false;
+        key = entries[next].first;
+        record = entries[next].second;
+        next++;
+        return true;
+    });
+    std::mutex treeMutex;
+    std::vector<double> lockedQuiet, lockedBusy;
+    measureReads(
+        [&]() {
+            std::lock_guard<std::mutex> lock(treeMutex);
+            lockedTree.rangeSearch(queryMin, queryMax);
+            lockedTree.rangeSearch(watchMin, deleteMax);
+        },
+        [&]() {
+            for (size_t first = 0; first < victims.size(); first += batchSize)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(treeMutex);
+                    for (size_t i = first; i < std::min(victims.size(), first + batchSize); i++)
+                    {
+                        lockedTree.deleteKey(victims[i]);
+                    }
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        },
+        lockedQuiet, lockedBusy);
+
+    printHeader("Snapshot Reads During Deletes");
+    printKeyValue("Keys deleted", std::to_string(victims.size()) + " (numVotes <= " + std::to_string(deleteMax) + ", " + std::to_string(batchSize) + " per batch)");
+    printKeyValue("Query", "numVotes in [" + std::to_string(queryMin) + ", " + std::to_string(queryMax) + "] and in [" +
+                               std::to_string(watchMin) + ", " + std::to_string(deleteMax) + "]");
+    printLatency("Copy-on-write, no writes", summarizeLatencies(cowQuiet));
+    printLatency("Copy-on-write, during deletes", summarizeLatencies(cowBusy));
+    printLatency("Locked tree, no writes", summarizeLatencies(lockedQuiet));
+    printLatency("Locked tree, during deletes", summarizeLatencies(lockedBusy));
+    printKeyValue("Every snapshot consistent", consistent ? "yes" : "no");
+    printKeyValue("All keys deleted", allDeleted ? "yes" : "no");
+    printKeyValue("Nodes reclaimed", std::to_string(cowTree.reclaimedNodes()));
+    printKeyValue("Nodes awaiting reclamation", std::to_string(cowTree.retiredNodes()));
+    printKeyValue("Hardware threads", std::to_string(std::thread::hardware_concurrency()));
+}
@@ -0,0 +1,89 @@
+#ifndef COWBPLUSTREE_H
+#define COWBPLUSTREE_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "BPlusTree.h"
+
+// Records of one key; immutable once published, shared by every version that contains it
+typedef std::vector<unsigned char *> Posting;
+
+struct CowNode
+{
+    bool isLeaf;
+    uint64_t version; // write batch that created the node, which may still change it in place
+    std::vector<int> keys;
+    std::vector<CowNode *> children;                      // internal nodes: keys.size() + 1 children
+    std::vector<std::shared_ptr<const Posting>> postings; // leaves: one posting per key
+};
+
+// B+ tree on numVotes with copy-on-write updates and snapshot reads.
+//
+// A write batch copies every node on the path it modifies (a node copied earlier
+// in the same batch is changed in place) and publishes the new root with one
+// atomic store, so readers never see a half-applied batch and never wait for the
+// writer. Leaves have no sibling links, since relinking a neighbour would mean
+// copying it too; range scans descend instead.
+//
+// Replaced nodes are retired with the epoch of the version that replaced them and
+// freed once every pinned reader has moved past that epoch. Deletes are relaxed:
+// empty nodes are removed but underfull ones are not merged, which keeps the path
+// copy to a single root-to-leaf path. One writer at a time.
+class CowBPlusTree
+{
+public:
+    static const int MAX_READERS = 64;
+
+    // Pinned view of one published version, valid until destroyed
+    class Snapshot
+    {
+        const CowBPlusTree *tree;
+        int slot;
+        const CowNode *root;
+
+    public:
+        Snapshot(const CowBPlusTree *tree, int slot, const CowNode *root);
+        Snapshot(Snapshot &&other);
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+        ~Snapshot();
+        std::vector<unsigned char *> search(int key) const;
+        std::vector<unsigned char *> rangeSearch(int minKey, int maxKey) const;
+    };
+
+    CowBPlusTree();
+    ~CowBPlusTree();
+    void load(const std::vector<std::pair<int, unsigned char *>> &sortedEntries);
+    void beginBatch();
+    void insert(int key, unsigned char *record);
+    bool erase(int key);
+    void commitBatch();
+    Snapshot snapshot() const;
+    size_t retiredNodes() const;
+    size_t reclaimedNodes() const;
+
+private:
+    std::atomic<CowNode *> root;
+    std::atomic<uint64_t> epoch;
+    mutable std::atomic<uint64_t> readerEpochs[MAX_READERS]; // 0 when the slot is free
+    CowNode *workingRoot;
+    uint64_t writeVersion;
+    bool inBatch;
+    std::vector<CowNode *> replacedInBatch;
+    std::vector<std::pair<uint64_t, CowNode *>> retired;
+    size_t reclaimed;
+
+    CowNode *writable(CowNode *node);
+    CowNode *insertInto(CowNode *node, int key, unsigned char *record, int &upKey, CowNode *&right);
+    CowNode *eraseFrom(CowNode *node, int key, bool &found);
+    void release(CowNode *node);
+    void reclaim();
+    void destroy(CowNode *node);
+};
+
+// Range-query latency while experiment 5-style deletes run in batches: copy-on-write snapshots against a B+ tree behind a lock
+void experimentSnapshotReads(const SimulatedDisk &disk);
+
+#endif // COWBPLUSTREE_H
@@ -0,0 +1,291 @@
+#include "ExternalSort.h"
+#include "BlockReader.h"
+#include <chrono>
+#include <cstdio>
+#include <queue>
+
+// Reads a run file back through a buffer of a fixed number of records
+class RunReader
+{
+    std::ifstream in;
+    std::vector<Record> buffer;
+    size_t position;
+    size_t filled;
+
+public:
+    RunReader(const std::string &filename, size_t bufferRecords)
+        : in(filename, std::ios::binary), buffer(bufferRecords), position(0), filled(0) {}
+
+    bool next(Record &record)
+    {
+        if (position == filled)
+        {
+            in.read(reinterpret_cast<char *>(buffer.data()), buffer.size() * sizeof(Record));
+            filled = (size_t)in.gcount() / sizeof(Record);
+            position = 0;
+            if (filled == 0)
+                return false;
+        }
+        record = buffer[position++];
+        return true;
+    }
+};
+
+ExternalSorter::ExternalSorter(size_t memoryBudget, const std::string &tempDir)
+    : memoryBudget(std::max(memoryBudget, (size_t)4 * BLOCK_SIZE)), tempDir(tempDir), runsCreated(0), spilled(0), passes(0)
+{
+    buffer.reserve(this->memoryBudget / sizeof(Record));
+}
+
+ExternalSorter::~ExternalSorter()
+{
+    for (const std::string &run : runs)
+    {
+        std::remove(run.c_str());
+    }
+}
+
+std::string ExternalSorter::nextRunName()
+{
+    return tempDir + "/sort_run_" + std::to_string((uintptr_t)this) + "_" + std::to_string(runsCreated++) + ".tmp";
+}
+
+static bool byVotes(const Record &a, const Record &b)
+{
+    return a.numVotes < b.numVotes;
+}
+
+void ExternalSorter::spillBuffer()
+{
+    std::stable_sort(buffer.begin(), buffer.end(), byVotes);
+    std::string name = nextRunName();
+    std::ofstream out(name, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(Record));
+    spilled += buffer.size() * sizeof(Record);
+    runs.push_back(name);
+    buffer.clear();
+}
+
+void ExternalSorter::add(const Record &record)
+{
+    if (buffer.size() == buffer.capacity())
+    {
+        spillBuffer();
+    }
+    buffer.push_back(record);
+}
+
+// k-way merge through a heap of the current head of every run; ties go to the earlier run
+void ExternalSorter::mergeRuns(const std::vector<std::string> &inputs, const std::function<void(const Record &)> &emit)
+{
+    size_t bufferRecords = std::max((size_t)1, memoryBudget / (inputs.size() + 1) / sizeof(Record));
+    std::vector<RunReader *> readers;
+    for (const std::string &input : inputs)
+    {
+        readers.push_back(new RunReader(input, bufferRecords));
+    }
+
+    typedef std::pair<Record, size_t> Head;
+    auto later = [](const Head &a, const Head &b) {
+        return a.first.numVotes != b.first.numVotes ? a.first.numVotes > b.first.numVotes : a.second > b.second;
+    };
+    std::priority_queue<Head, std::vector<Head>, decltype(later)> heap(later);
+    Record record;
+    for (size_t i = 0; i < readers.size(); i++)
+    {
+        if (readers[i]->next(record))
+            heap.push(Head(record, i));
+    }
+    while (!heap.empty())
+    {
+        Head head = heap.top();
+        heap.pop();
+        emit(head.first);
+        if (readers[head.second]->next(record))
+            heap.push(Head(record, head.second));
+    }
+
+    for (RunReader *reader : readers)
+    {
+        delete reader;
+    }
+}
+
+void ExternalSorter::finish(const std::function<void(const Record &)> &emit)
+{
+    if (runs.empty())
+    {
+        // Everything fit in memory
+        std::stable_sort(buffer.begin(), buffer.end(), byVotes);
+        for (const Record &record : buffer)
+        {
+            emit(record);
+        }
+        buffer.clear();
+        return;
+    }
+    if (!buffer.empty())
+    {
+        spillBuffer();
+    }
+    std::vector<Record>().swap(buffer); // the merge buffers take the budget from here on
+
+    // Every input of a merge needs at least one block of buffer
+    size_t maxFanIn = std::max((size_t)2, memoryBudget / BLOCK_SIZE - 1);
+    while (runs.size() > maxFanIn)
+    {
+        std::vector<std::string> merged;
+        for (size_t first = 0; first < runs.size(); first += maxFanIn)
+        {
+            std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(runs.size(), first + maxFanIn));
+            std::string name = nextRunName();
+            std::ofstream out(name, std::ios::binary);
+            mergeRuns(group, [&](const Record &record) {
+                out.write(reinterpret_cast<const char *>(&record), sizeof(Record));
+                spilled += sizeof(Record);
+            });
+            for (const std::string &run : group)
+            {
+                std::remove(run.c_str());
+            }
+            merged.push_back(name);
+        }
+        runs.swap(merged);
+        passes++;
+    }
+    mergeRuns(runs, emit);
+    passes++;
+    for (const std::string &run : runs)
+    {
+        std::remove(run.c_str());
+    }
+    runs.clear();
+}
+
+size_t ExternalSorter::sortTSV(const std::string &filename, const std::function<void(const Record &)> &emit)
+{
+    size_t rows = 0;
+    readTSVRows(filename, [&](const std::vector<std::string> &fields, const std::string &line) {
+        if (fields.size() < 3)
+            return;
+        add(Record(fields[0], convertToFloat(fields[1], line), convertToInt(fields[2], line)));
+        rows++;
+    });
+    finish(emit);
+    return rows;
+}
+
+// Data file written by SimulatedDisk::writeToDisk, read sequentially one block at a time
+size_t ExternalSorter::sortBlockFile(const std::string &filename, const std::function<void(const Record &)> &emit)
+{
+    std::ifstream in(filename, std::ios::binary);
+    std::vector<unsigned char> raw(BLOCK_SIZE);
+    Block block;
+    size_t rows = 0;
+    while (in.read(reinterpret_cast<char *>(raw.data()), BLOCK_SIZE) || in.gcount() > 0)
+    {
+        BlockFile::decodeBlock(raw.data(), (size_t)in.gcount(), block);
+        for (const Record &record : block.records)
+        {
+            add(record);
+            rows++;
+        }
+    }
+    finish(emit);
+    return rows;
+}
+
+uint64_t ExternalSorter::bytesSpilled() const
+{
+    return spilled;
+}
+
+size_t ExternalSorter::runsWritten() const
+{
+    return runsCreated;
+}
+
+int ExternalSorter::mergePasses() const
+{
+    return passes;
+}
+
+void experimentExternalSort(size_t memoryBudget)
+{
+    // The sorted stream is packed into a fresh disk, so the data blocks end up clustered on numVotes
+    SimulatedDisk sortedDisk;
+    BPlusTree tree;
+    Block currentBlock;
+
+    ExternalSorter sorter(memoryBudget);
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t rows = sorter.sortBlockFile("Data.dat", [&](const Record &record) {
+        if (!currentBlock.canAddRecord())
+        {
+            sortedDisk.addBlock(currentBlock);
+            currentBlock = Block();
+        }
+        currentBlock.addRecord(record);
+    });
+    if (currentBlock.size() > 0)
+    {
+        sortedDisk.addBlock(currentBlock);
+    }
+    auto sorted = std::chrono::high_resolution_clock::now();
+
+    // Records only have their final address once their block is on the disk, so the
+    // bulk loader then streams them back in disk order, which is numVotes order
+    std::vector<Block> &blocks = sortedDisk.getBlocks();
+    size_t blockId = 0, slot = 0;
+    tree.bulkLoad([&](int &key, unsigned char *&recordPtr) {
+        while (blockId < blocks.size() && slot == blocks[blockId].records.size())
+        {
+            blockId++;
+            slot = 0;
+        }
+        if (blockId == blocks.size())
+            return false;
+        Record &record = blocks[blockId].records[slot++];
+        key = record.numVotes;
+        recordPtr = reinterpret_cast<unsigned char *>(&record);
+        return true;
+    });
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> sortDuration = sorted - start;
+    std::chrono::duration<double, std::milli> loadDuration = end - sorted;
+
+    if (rows == 0)
+    {
+        std::cout << "Data.dat is empty or missing, run experiment 1 first" << std::endl;
+        return;
+    }
+
+    // Check the result: the leaf level holds every record in key order, both ways
+    std::vector<unsigned char *> forward = tree.rangeSearch(INT_MIN, INT_MAX);
+    bool inOrder = forward.size() == rows;
+    for (size_t i = 1; inOrder && i < forward.size(); i++)
+    {
+        inOrder = reinterpret_cast<Record *>(forward[i - 1])->numVotes <= reinterpret_cast<Record *>(forward[i])->numVotes;
+    }
+    size_t backward = 0;
+    for (ReverseCursor cursor = tree.reverseScan(); cursor.valid(); ++cursor)
+    {
+        backward++;
+    }
+
+    printHeader("External Sort");
+    printKeyValue("Memory budget", std::to_string(memoryBudget) + " bytes");
+    printKeyValue("Records sorted", std::to_string(rows));
+    printKeyValue("Runs written", std::to_string(sorter.runsWritten()));
+    printKeyValue("Merge passes", std::to_string(sorter.mergePasses()));
+    printKeyValue("Bytes spilled", std::to_string(sorter.bytesSpilled()));
+    printKeyValue("Sort time", std::to_string(sortDuration.count()) + " milliseconds");
+
+    printHeader("Bulk Load");
+    printKeyValue("Number of nodes", std::to_string(tree.nodeCount()));
+    printKeyValue("Number of levels", std::to_string(tree.height()));
+    printKeyValue("Number of leaves", std::to_string(tree.leafCount()));
+    printKeyValue("Number of keys", std::to_string(tree.keyCount()));
+    printKeyValue("Bulk load time", std::to_string(loadDuration.count()) + " milliseconds");
+    printKeyValue("Leaf chain in key order", inOrder && backward == rows ? "yes" : "no");
+}
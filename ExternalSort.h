@@ -0,0 +1,44 @@
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "Storage.h"
+
+// Sorts records on numVotes within a fixed memory budget. Records are collected
+// until the budget is full, then sorted and spilled to a temporary run file.
+// finish() merges the runs, in several passes if one merge would need more
+// input buffers than the budget holds, and streams the records out in order.
+// Records with equal numVotes keep their input order.
+class ExternalSorter
+{
+    size_t memoryBudget;
+    std::string tempDir;
+    std::vector<Record> buffer;
+    std::vector<std::string> runs;
+    size_t runsCreated;
+    uint64_t spilled;
+    int passes;
+
+    std::string nextRunName();
+    void spillBuffer();
+    void mergeRuns(const std::vector<std::string> &inputs, const std::function<void(const Record &)> &emit);
+
+public:
+    ExternalSorter(size_t memoryBudget, const std::string &tempDir = ".");
+    ~ExternalSorter();
+    void add(const Record &record);
+    void finish(const std::function<void(const Record &)> &emit);
+    size_t sortTSV(const std::string &filename, const std::function<void(const Record &)> &emit);
+    size_t sortBlockFile(const std::string &filename, const std::function<void(const Record &)> &emit);
+    uint64_t bytesSpilled() const;
+    size_t runsWritten() const;
+    int mergePasses() const;
+};
+
+// External sort of the ratings TSV with a small memory budget, streamed into a bulk-loaded B+ tree
+void experimentExternalSort(size_t memoryBudget);
+
+#endif // EXTERNALSORT_H
@@ -0,0 +1,305 @@
+#include "HashIndex.h"
+#include "PrefixBPlusTree.h"
+#include <chrono>
+#include <random>
+
+static const double MAX_LOAD_FACTOR = 0.85;
+static const char INDEX_FILE_MAGIC[4] = {'H', 'I', 'D', 'X'};
+
+HashIndex::HashIndex(size_t expectedKeys) : count(0), mask(0)
+{
+    size_t capacity = 16;
+    while (capacity * MAX_LOAD_FACTOR < expectedKeys)
+        capacity *= 2;
+    rehash(capacity);
+}
+
+// FNV-1a over the key bytes
+uint64_t HashIndex::hashKey(const char *key)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < KEY_BYTES && key[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Keys are compared with memcmp, so pad them with zeros
+void HashIndex::copyKey(char *dest, const char *tconst)
+{
+    std::memset(dest, 0, KEY_BYTES);
+    std::strncpy(dest, tconst, KEY_BYTES - 1);
+}
+
+void HashIndex::rehash(size_t newCapacity)
+{
+    std::vector<Slot> oldSlots;
+    oldSlots.swap(slots);
+    Slot empty;
+    std::memset(&empty, 0, sizeof(Slot));
+    slots.assign(newCapacity, empty);
+    mask = newCapacity - 1;
+    count = 0;
+
+    for (const Slot &slot : oldSlots)
+    {
+        if (slot.distance != 0)
+            insert(slot.key, slot.location);
+    }
+}
+
+long HashIndex::findSlot(const char *key) const
+{
+    size_t i = hashKey(key) & mask;
+    for (uint16_t distance = 1;; distance++)
+    {
+        const Slot &slot = slots[i];
+        if (slot.distance < distance)
+            return -1; // empty, or an entry richer than us: the key cannot be further along
+        if (slot.distance == distance && std::memcmp(slot.key, key, KEY_BYTES) == 0)
+            return (long)i;
+        i = (i + 1) & mask;
+    }
+}
+
+void HashIndex::insert(const char *tconst, const RecordLocation &location)
+{
+    Slot entry;
+    copyKey(entry.key, tconst);
+    entry.location = location;
+
+    long existing = findSlot(entry.key);
+    if (existing >= 0)
+    {
+        slots[existing].location = location;
+        return;
+    }
+
+    if (count + 1 > slots.size() * MAX_LOAD_FACTOR)
+        rehash(slots.size() * 2);
+
+    entry.distance = 1;
+    size_t i = hashKey(entry.key) & mask;
+    while (true)
+    {
+        Slot &slot = slots[i];
+        if (slot.distance == 0)
+        {
+            slot = entry;
+            count++;
+            return;
+        }
+        // Take the slot from an entry that is closer to its home
+        if (slot.distance < entry.distance)
+            std::swap(slot, entry);
+        entry.distance++;
+        i = (i + 1) & mask;
+    }
+}
+
+bool HashIndex::find(const char *tconst, RecordLocation &location) const
+{
+    char key[KEY_BYTES];
+    copyKey(key, tconst);
+    long i = findSlot(key);
+    if (i < 0)
+        return false;
+    location = slots[i].location;
+    return true;
+}
+
+bool HashIndex::erase(const char *tconst)
+{
+    char key[KEY_BYTES];
+    copyKey(key, tconst);
+    long found = findSlot(key);
+    if (found < 0)
+        return false;
+
+    // Backward shift deletion keeps probe sequences intact without tombstones
+    size_t i = (size_t)found;
+    size_t nextSlot = (i + 1) & mask;
+    while (slots[nextSlot].distance > 1)
+    {
+        slots[i] = slots[nextSlot];
+        slots[i].distance--;
+        i = nextSlot;
+        nextSlot = (nextSlot + 1) & mask;
+    }
+    slots[i].distance = 0;
+    count--;
+    return true;
+}
+
+void HashIndex::build(const SimulatedDisk &disk)
+{
+    const std::vector<Block> &blocks = disk.getBlocks();
+    size_t total = disk.totalRecords();
+    size_t capacity = 16;
+    while (capacity * MAX_LOAD_FACTOR < total)
+        capacity *= 2;
+    if (capacity > slots.size())
+        rehash(capacity);
+
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        for (size_t r = 0; r < blocks[b].records.size(); r++)
+        {
+            if (blocks[b].records[r].isDeleted())
+                continue;
+            RecordLocation location;
+            location.blockId = (uint32_t)b;
+            location.slot = (uint32_t)r;
+            insert(blocks[b].records[r].tconst, location);
+        }
+    }
+}
+
+bool HashIndex::saveToFile(const std::string &filename) const
+{
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open())
+    {
+        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        return false;
+    }
+    uint64_t header[2] = {slots.size(), count};
+    out.write(INDEX_FILE_MAGIC, sizeof(INDEX_FILE_MAGIC));
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(slots.data()), slots.size() * sizeof(Slot));
+    return out.good();
+}
+
+bool HashIndex::loadFromFile(const std::string &filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open())
+    {
+        std::cerr << "Failed to open file for reading: " << filename << std::endl;
+        return false;
+    }
+    char magic[4];
+    uint64_t header[2];
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (!in || std::memcmp(magic, INDEX_FILE_MAGIC, sizeof(magic)) != 0 || header[0] == 0 || (header[0] & (header[0] - 1)) != 0)
+    {
+        std::cerr << "Not a hash index file: " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<Slot> loaded(header[0]);
+    in.read(reinterpret_cast<char *>(loaded.data()), loaded.size() * sizeof(Slot));
+    if (!in)
+    {
+        std::cerr << "Hash index file is truncated: " << filename << std::endl;
+        return false;
+    }
+    slots.swap(loaded);
+    count = header[1];
+    mask = slots.size() - 1;
+    return true;
+}
+
+size_t HashIndex::size() const
+{
+    return count;
+}
+
+size_t HashIndex::capacity() const
+{
+    return slots.size();
+}
+
+int HashIndex::maxProbeDistance() const
+{
+    int maxDistance = 0;
+    for (const Slot &slot : slots)
+        maxDistance = std::max(maxDistance, (int)slot.distance);
+    return maxDistance;
+}
+
+void experimentHashIndex(SimulatedDisk &disk)
+{
+    HashIndex hashIndex;
+    PrefixBPlusTree tree(true);
+    std::vector<std::string> probes;
+
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    hashIndex.build(disk);
+    auto buildEnd = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> hashBuild = buildEnd - buildStart;
+
+    buildStart = std::chrono::high_resolution_clock::now();
+    for (Block &block : disk.getBlocks())
+    {
+        for (Record &record : block.records)
+        {
+            if (record.isDeleted())
+                continue;
+            tree.insertKey(record.tconst, reinterpret_cast<unsigned char *>(&record));
+        }
+    }
+    buildEnd = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> treeBuild = buildEnd - buildStart;
+
+    for (const Block &block : disk.getBlocks())
+    {
+        for (const Record &record : block.records)
+        {
+            if (!record.isDeleted())
+                probes.push_back(record.tconst);
+        }
+    }
+    std::mt19937 rng(3020);
+    std::shuffle(probes.begin(), probes.end(), rng);
+    if (probes.size() > 100000)
+        probes.resize(100000);
+
+    int hashFound = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::string &key : probes)
+    {
+        RecordLocation location;
+        if (hashIndex.find(key.c_str(), location) && disk.getRecord(location) != nullptr)
+            hashFound++;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> hashLookup = end - start;
+
+    int treeFound = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (const std::string &key : probes)
+    {
+        if (tree.search(key) != nullptr)
+            treeFound++;
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> treeLookup = end - start;
+
+    start = std::chrono::high_resolution_clock::now();
+    bool saved = hashIndex.saveToFile("tconst.idx");
+    HashIndex reloaded;
+    bool loaded = saved && reloaded.loadFromFile("tconst.idx");
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> persist = end - start;
+
+    size_t n = probes.empty() ? 1 : probes.size();
+    printHeader("Hash Index on tconst");
+    printKeyValue("Number of keys", std::to_string(hashIndex.size()));
+    printKeyValue("Number of slots", std::to_string(hashIndex.capacity()));
+    printKeyValue("Longest probe sequence", std::to_string(hashIndex.maxProbeDistance()));
+    printKeyValue("Build time", std::to_string(hashBuild.count()) + " milliseconds");
+    printKeyValue("Lookups (found)", std::to_string(probes.size()) + " (" + std::to_string(hashFound) + ")");
+    printKeyValue("Average lookup latency", std::to_string(hashLookup.count() / n) + " ns");
+    printKeyValue("Save and reload tconst.idx", loaded ? std::to_string(persist.count()) + " milliseconds" : "failed");
+
+    printHeader("B+ Tree on tconst");
+    printKeyValue("Number of nodes", std::to_string(tree.getNodes()));
+    printKeyValue("Number of levels", std::to_string(tree.getLevels()));
+    printKeyValue("Build time", std::to_string(treeBuild.count()) + " milliseconds");
+    printKeyValue("Lookups (found)", std::to_string(probes.size()) + " (" + std::to_string(treeFound) + ")");
+    printKeyValue("Average lookup latency", std::to_string(treeLookup.count() / n) + " ns");
+}
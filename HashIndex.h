@@ -0,0 +1,48 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Storage.h"
+
+// Open-addressing hash index from tconst to record location.
+// Collisions are resolved with Robin Hood linear probing, so lookups stop as
+// soon as they pass an entry that is closer to its home slot than they are.
+class HashIndex
+{
+    static const size_t KEY_BYTES = sizeof(((Record *)0)->tconst);
+
+    struct Slot
+    {
+        char key[KEY_BYTES];
+        uint16_t distance; // probe distance + 1, 0 marks an empty slot
+        RecordLocation location;
+    };
+
+    std::vector<Slot> slots;
+    size_t count;
+    size_t mask;
+
+    static uint64_t hashKey(const char *key);
+    static void copyKey(char *dest, const char *tconst);
+    void rehash(size_t newCapacity);
+    long findSlot(const char *key) const;
+
+public:
+    HashIndex(size_t expectedKeys = 0);
+    void insert(const char *tconst, const RecordLocation &location);
+    bool find(const char *tconst, RecordLocation &location) const;
+    bool erase(const char *tconst);
+    void build(const SimulatedDisk &disk);
+    bool saveToFile(const std::string &filename) const;
+    bool loadFromFile(const std::string &filename);
+    size_t size() const;
+    size_t capacity() const;
+    int maxProbeDistance() const;
+};
+
+// Compare hash index point lookups on tconst with the tconst B+ tree
+void experimentHashIndex(SimulatedDisk &disk);
+
+#endif // HASHINDEX_H
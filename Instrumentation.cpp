@@ -0,0 +1,295 @@
+#include "Instrumentation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "Storage.h"
+#if defined(BPTREE_INSTRUMENT) && defined(BPTREE_PERF_EVENTS) && defined(__linux__)
+#define PERF_EVENTS_ENABLED
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<uint64_t> instrumentCounters[NUM_OPERATIONS][NUM_COUNTERS];
+LatencyHistogram instrumentLatencies[NUM_OPERATIONS];
+thread_local int currentOperation = OP_OTHER;
+
+static std::atomic<uint64_t> perfTotals[NUM_OPERATIONS][NUM_PERF_EVENTS];
+static std::atomic<uint64_t> perfOperations[NUM_OPERATIONS];
+static std::atomic<int> perfError(0); // errno of the first perf_event_open that failed
+
+#ifdef BPTREE_INSTRUMENT
+static const char *operationNames[NUM_OPERATIONS] = {"Insert", "Delete", "Lookup", "Range search", "Other"};
+static const char *counterNames[NUM_COUNTERS] = {"Node visits", "Key comparisons", "Splits", "Merges", "Posting list hops", "Node allocations"};
+static const char *perfEventNames[NUM_PERF_EVENTS] = {"Cycles", "LLC misses", "Branch misses"};
+#endif
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+int LatencyHistogram::bucketOf(uint64_t nanoseconds)
+{
+    if (nanoseconds < 16)
+        return (int)nanoseconds;
+    int exponent = 63 - __builtin_clzll(nanoseconds);
+    int sub = (int)((nanoseconds >> (exponent - 3)) & 7);
+    return 16 + (exponent - 4) * 8 + sub;
+}
+
+uint64_t LatencyHistogram::upperEdge(int bucket)
+{
+    if (bucket < 16)
+        return (uint64_t)bucket;
+    int exponent = (bucket - 16) / 8 + 4;
+    uint64_t lower = (uint64_t)(8 + (bucket - 16) % 8) << (exponent - 3);
+    return lower + ((uint64_t)1 << (exponent - 3)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds)
+{
+    buckets[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++)
+    {
+        total += buckets[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    uint64_t total = count();
+    if (total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * total);
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank)
+            return upperEdge(i);
+    }
+    return upperEdge(NUM_BUCKETS - 1);
+}
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < NUM_BUCKETS; i++)
+    {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+double sortedPercentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::min(sorted.size(), std::max((size_t)1, rank)) - 1];
+}
+
+LatencySummary summarizeLatencies(std::vector<double> &latencies)
+{
+    LatencySummary summary = {latencies.size(), 0.0, 0.0, 0.0, 0.0, 0.0};
+    if (latencies.empty())
+        return summary;
+    std::sort(latencies.begin(), latencies.end());
+    for (double latency : latencies)
+    {
+        summary.mean += latency;
+    }
+    summary.mean /= latencies.size();
+    summary.p50 = sortedPercentile(latencies, 50.0);
+    summary.p99 = sortedPercentile(latencies, 99.0);
+    summary.p999 = sortedPercentile(latencies, 99.9);
+    summary.max = latencies.back();
+    return summary;
+}
+
+#ifdef PERF_EVENTS_ENABLED
+// One counter group per thread, opened on the first operation of the thread
+struct PerfGroup
+{
+    int fds[NUM_PERF_EVENTS];
+    bool opened;
+
+    PerfGroup() : opened(false)
+    {
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            fds[i] = -1;
+        }
+    }
+
+    ~PerfGroup()
+    {
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            if (fds[i] >= 0)
+                close(fds[i]);
+        }
+    }
+
+    bool open()
+    {
+        if (opened)
+            return fds[0] >= 0;
+        opened = true;
+        const uint64_t configs[NUM_PERF_EVENTS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+            if (fds[i] < 0)
+            {
+                int expected = 0;
+                perfError.compare_exchange_strong(expected, errno);
+                for (int j = 0; j <= i; j++)
+                {
+                    if (fds[j] >= 0)
+                        close(fds[j]);
+                    fds[j] = -1;
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool read(uint64_t values[NUM_PERF_EVENTS])
+    {
+        struct
+        {
+            uint64_t count;
+            uint64_t values[NUM_PERF_EVENTS];
+        } group;
+        if (!open() || ::read(fds[0], &group, sizeof(group)) != (ssize_t)sizeof(group))
+            return false;
+        std::memcpy(values, group.values, sizeof(group.values));
+        return true;
+    }
+};
+
+static thread_local PerfGroup perfGroup;
+#endif
+
+static uint64_t nowNanoseconds()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+OperationScope::OperationScope(InstrumentedOperation operation) : operation(operation), outermost(currentOperation == OP_OTHER)
+{
+    if (!outermost)
+        return;
+    currentOperation = operation;
+#ifdef PERF_EVENTS_ENABLED
+    if (!perfGroup.read(perfStart))
+        perfStart[0] = UINT64_MAX;
+#endif
+    start = nowNanoseconds();
+}
+
+OperationScope::~OperationScope()
+{
+    if (!outermost)
+        return;
+    instrumentLatencies[operation].record(nowNanoseconds() - start);
+#ifdef PERF_EVENTS_ENABLED
+    uint64_t perfEnd[NUM_PERF_EVENTS];
+    if (perfStart[0] != UINT64_MAX && perfGroup.read(perfEnd))
+    {
+        for (int i = 0; i < NUM_PERF_EVENTS; i++)
+        {
+            perfTotals[operation][i].fetch_add(perfEnd[i] - perfStart[i], std::memory_order_relaxed);
+        }
+        perfOperations[operation].fetch_add(1, std::memory_order_relaxed);
+    }
+#endif
+    currentOperation = OP_OTHER;
+}
+
+void dumpInstrumentation()
+{
+    printHeader("Instrumentation");
+#ifndef BPTREE_INSTRUMENT
+    std::cout << "Instrumentation is compiled out, rebuild with -DBPTREE_INSTRUMENT (and -DBPTREE_PERF_EVENTS for hardware counters)" << std::endl;
+#else
+    bool any = false;
+    for (int op = 0; op < NUM_OPERATIONS; op++)
+    {
+        uint64_t operations = instrumentLatencies[op].count();
+        uint64_t events = 0;
+        for (int c = 0; c < NUM_COUNTERS; c++)
+        {
+            events += instrumentCounters[op][c].load(std::memory_order_relaxed);
+        }
+        if (operations == 0 && events == 0)
+            continue;
+        any = true;
+
+        printHeader(operationNames[op]);
+        if (op != OP_OTHER)
+            printKeyValue("Operations", std::to_string(operations));
+        for (int c = 0; c < NUM_COUNTERS; c++)
+        {
+            uint64_t total = instrumentCounters[op][c].load(std::memory_order_relaxed);
+            std::string value = std::to_string(total);
+            if (operations > 0)
+                value += " (" + std::to_string((double)total / operations) + " per operation)";
+            printKeyValue(counterNames[c], value);
+        }
+        if (operations > 0)
+        {
+            const LatencyHistogram &latencies = instrumentLatencies[op];
+            printKeyValue("Latency p50 / p99 / p99.9", std::to_string(latencies.percentile(50.0)) + " / " + std::to_string(latencies.percentile(99.0)) +
+                                                           " / " + std::to_string(latencies.percentile(99.9)) + " ns");
+        }
+        uint64_t perfCount = perfOperations[op].load(std::memory_order_relaxed);
+        for (int e = 0; e < NUM_PERF_EVENTS && perfCount > 0; e++)
+        {
+            printKeyValue(perfEventNames[e], std::to_string((double)perfTotals[op][e].load(std::memory_order_relaxed) / perfCount) + " per operation");
+        }
+    }
+    if (!any)
+        std::cout << "Nothing recorded yet, run some experiments first" << std::endl;
+#ifdef PERF_EVENTS_ENABLED
+    if (perfError.load() != 0)
+        printKeyValue("Perf events", std::string("unavailable, ") + std::strerror(perfError.load()));
+#else
+    printKeyValue("Perf events", "compiled out");
+#endif
+#endif
+}
+
+void resetInstrumentation()
+{
+    for (int op = 0; op < NUM_OPERATIONS; op++)
+    {
+        for (int c = 0; c < NUM_COUNTERS; c++)
+        {
+            instrumentCounters[op][c].store(0, std::memory_order_relaxed);
+        }
+        for (int e = 0; e < NUM_PERF_EVENTS; e++)
+        {
+            perfTotals[op][e].store(0, std::memory_order_relaxed);
+        }
+        perfOperations[op].store(0, std::memory_order_relaxed);
+        instrumentLatencies[op].reset();
+    }
+}
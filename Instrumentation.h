@@ -0,0 +1,134 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hot-path counters for the B+ tree, compiled in with -DBPTREE_INSTRUMENT.
+//
+// Without the flag every INSTRUMENT_ macro expands to nothing, so the tree code pays
+// nothing for them. With it, every counted event is added to the counters of the
+// operation the calling thread is running (OP_OTHER outside any), each operation's
+// latency goes into a lock-free histogram, and with -DBPTREE_PERF_EVENTS as well the
+// cycles, last-level cache misses and branch misses of every operation are read through
+// perf_event_open. The perf counters cost two system calls per operation.
+
+enum InstrumentedOperation
+{
+    OP_INSERT,
+    OP_DELETE,
+    OP_LOOKUP,
+    OP_RANGE,
+    OP_OTHER, // events outside any operation, bulk loads and experiments
+    NUM_OPERATIONS
+};
+
+enum InstrumentedCounter
+{
+    COUNT_NODE_VISITS,
+    COUNT_KEY_COMPARISONS,
+    COUNT_SPLITS,
+    COUNT_MERGES,
+    COUNT_POSTING_HOPS, // moves from one buffer node of a posting list to the next
+    COUNT_ALLOCATIONS,
+    NUM_COUNTERS
+};
+
+enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    NUM_PERF_EVENTS
+};
+
+// Latencies in buckets of a log-linear scale: exact below 16 ns, then eight buckets per
+// power of two, so every bucket is within 12.5% of the values it holds. Updates are
+// relaxed atomic increments; readers may see a histogram that is a few updates behind.
+class LatencyHistogram
+{
+public:
+    static const int NUM_BUCKETS = 16 + 60 * 8;
+
+    LatencyHistogram();
+    void record(uint64_t nanoseconds);
+    uint64_t count() const;
+    uint64_t percentile(double p) const; // upper edge of the bucket holding the p-th percentile
+    void reset();
+
+private:
+    std::atomic<uint64_t> buckets[NUM_BUCKETS];
+
+    static int bucketOf(uint64_t nanoseconds);
+    static uint64_t upperEdge(int bucket);
+};
+
+// Exact percentiles of a set of latency samples, for experiments that keep every sample.
+// Percentiles use the nearest rank: the smallest sample with at least p% of them at or below it.
+struct LatencySummary
+{
+    size_t count;
+    double mean;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+double sortedPercentile(const std::vector<double> &sorted, double p);
+LatencySummary summarizeLatencies(std::vector<double> &latencies); // sorts latencies
+
+extern std::atomic<uint64_t> instrumentCounters[NUM_OPERATIONS][NUM_COUNTERS];
+extern LatencyHistogram instrumentLatencies[NUM_OPERATIONS];
+extern thread_local int currentOperation;
+
+inline void instrumentCount(int operation, InstrumentedCounter counter, uint64_t n)
+{
+    instrumentCounters[operation][counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+// Marks the calling thread as running operation for its lifetime and records its latency.
+// Nested scopes are counted as part of the outermost one.
+class OperationScope
+{
+    int operation;
+    bool outermost;
+    uint64_t start;
+    uint64_t perfStart[NUM_PERF_EVENTS];
+
+public:
+    explicit OperationScope(InstrumentedOperation operation);
+    ~OperationScope();
+    OperationScope(const OperationScope &) = delete;
+    OperationScope &operator=(const OperationScope &) = delete;
+};
+
+#ifdef BPTREE_INSTRUMENT
+#define INSTRUMENT_OPERATION(op) OperationScope instrumentScope(op)
+#define INSTRUMENT_COUNT(counter) instrumentCount(currentOperation, counter, 1)
+#define INSTRUMENT_ADD(counter, n) instrumentCount(currentOperation, counter, (uint64_t)(n))
+#define INSTRUMENT_COUNT_AS(op, counter) instrumentCount(currentOperation == OP_OTHER ? op : currentOperation, counter, 1)
+#else
+#define INSTRUMENT_OPERATION(op) ((void)0)
+#define INSTRUMENT_COUNT(counter) ((void)0)
+#define INSTRUMENT_ADD(counter, n) ((void)0)
+#define INSTRUMENT_COUNT_AS(op, counter) ((void)0)
+#endif
+
+// Less-than on keys that counts itself as a key comparison, for the standard binary searches
+struct CountingLess
+{
+    bool operator()(int a, int b) const
+    {
+        INSTRUMENT_COUNT(COUNT_KEY_COMPARISONS);
+        return a < b;
+    }
+};
+
+// Print the counters, per-operation averages, latency percentiles and perf counters collected so far
+void dumpInstrumentation();
+void resetInstrumentation();
+
+#endif // INSTRUMENTATION_H
@@ -0,0 +1,199 @@
+#include "Join.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static const size_t KEY_BYTES = sizeof(((Record *)0)->tconst);
+
+static int compareKeys(const char *a, const char *b)
+{
+    return std::strncmp(a, b, KEY_BYTES);
+}
+
+size_t hashJoin(const std::vector<const TitleRecord *> &titles, const SimulatedDisk &ratings, const JoinCallback &emit)
+{
+    const std::vector<Block> &blocks = ratings.getBlocks();
+    size_t matches = 0;
+    RecordLocation location;
+
+    if (titles.size() <= ratings.totalRecords())
+    {
+        // Build on the titles; blockId holds the position in titles
+        HashIndex table(titles.size());
+        for (size_t i = 0; i < titles.size(); i++)
+        {
+            table.insert(titles[i]->tconst, {(uint32_t)i, 0});
+        }
+        for (const Block &block : blocks)
+        {
+            for (const Record &record : block.records)
+            {
+                if (!record.isDeleted() && table.find(record.tconst, location))
+                {
+                    emit(record, *titles[location.blockId]);
+                    matches++;
+                }
+            }
+        }
+    }
+    else
+    {
+        HashIndex table(ratings.totalRecords());
+        table.build(ratings);
+        for (const TitleRecord *title : titles)
+        {
+            if (table.find(title->tconst, location))
+            {
+                emit(blocks[location.blockId].records[location.slot], *title);
+                matches++;
+            }
+        }
+    }
+    return matches;
+}
+
+size_t indexNestedLoopJoin(const std::vector<const TitleRecord *> &titles, const SimulatedDisk &ratings, const HashIndex &ratingsIndex, const JoinCallback &emit)
+{
+    const std::vector<Block> &blocks = ratings.getBlocks();
+    size_t matches = 0;
+    RecordLocation location;
+    for (const TitleRecord *title : titles)
+    {
+        if (ratingsIndex.find(title->tconst, location))
+        {
+            emit(blocks[location.blockId].records[location.slot], *title);
+            matches++;
+        }
+    }
+    return matches;
+}
+
+size_t sortMergeJoin(const std::vector<const TitleRecord *> &titles, const SimulatedDisk &ratings, const JoinCallback &emit)
+{
+    std::vector<const Record *> left;
+    left.reserve(ratings.totalRecords());
+    for (const Block &block : ratings.getBlocks())
+    {
+        for (const Record &record : block.records)
+        {
+            if (!record.isDeleted())
+                left.push_back(&record);
+        }
+    }
+    std::vector<const TitleRecord *> right(titles);
+    std::sort(left.begin(), left.end(), [](const Record *a, const Record *b) { return compareKeys(a->tconst, b->tconst) < 0; });
+    std::sort(right.begin(), right.end(), [](const TitleRecord *a, const TitleRecord *b) { return compareKeys(a->tconst, b->tconst) < 0; });
+
+    size_t matches = 0;
+    size_t i = 0, j = 0;
+    while (i < left.size() && j < right.size())
+    {
+        int order = compareKeys(left[i]->tconst, right[j]->tconst);
+        if (order < 0)
+        {
+            i++;
+        }
+        else if (order > 0)
+        {
+            j++;
+        }
+        else
+        {
+            // Pair the runs of equal keys on both sides
+            size_t runEnd = j;
+            while (runEnd < right.size() && compareKeys(left[i]->tconst, right[runEnd]->tconst) == 0)
+                runEnd++;
+            const char *key = left[i]->tconst;
+            for (; i < left.size() && compareKeys(left[i]->tconst, key) == 0; i++)
+            {
+                for (size_t k = j; k < runEnd; k++)
+                {
+                    emit(*left[i], *right[k]);
+                    matches++;
+                }
+            }
+            j = runEnd;
+        }
+    }
+    return matches;
+}
+
+void experimentJoins(SimulatedDisk &disk, const std::string &titlesFilename)
+{
+    if (disk.totalRecords() == 0)
+    {
+        std::cout << "The disk is empty, run experiment 1 first" << std::endl;
+        return;
+    }
+
+    TitleTable titleTable;
+    titleTable.load(titlesFilename);
+    if (titleTable.totalRecords() == 0)
+    {
+        std::cout << "No titles loaded from " << titlesFilename << std::endl;
+        return;
+    }
+    std::vector<const TitleRecord *> allTitles;
+    for (const std::vector<TitleRecord> &block : titleTable.getBlocks())
+    {
+        for (const TitleRecord &title : block)
+        {
+            allTitles.push_back(&title);
+        }
+    }
+
+    printHeader("Title Table");
+    printKeyValue("Number of titles", std::to_string(titleTable.totalRecords()));
+    printKeyValue("Size of a title record", std::to_string(sizeof(TitleRecord)) + " bytes");
+    printKeyValue("Number of blocks", std::to_string(titleTable.totalBlocks()));
+
+    // The index nested-loop join uses an index that already exists, so it is built outside the timings
+    auto start = std::chrono::high_resolution_clock::now();
+    HashIndex ratingsIndex(disk.totalRecords());
+    ratingsIndex.build(disk);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> indexDuration = end - start;
+    printKeyValue("tconst index build time", std::to_string(indexDuration.count()) + " milliseconds");
+
+    double checksum = 0.0; // consumes the joined pairs so no operator can skip the work
+    JoinCallback emit = [&checksum](const Record &rating, const TitleRecord &title) {
+        checksum += rating.averageRating + title.startYear;
+    };
+
+    for (size_t numTitles = 1000;; numTitles *= 10)
+    {
+        numTitles = std::min(numTitles, allTitles.size());
+        std::vector<const TitleRecord *> titles(allTitles.begin(), allTitles.begin() + numTitles);
+
+        size_t matches[3];
+        double elapsed[3];
+        double checksums[3];
+        for (int op = 0; op < 3; op++)
+        {
+            checksum = 0.0;
+            start = std::chrono::high_resolution_clock::now();
+            if (op == 0)
+                matches[op] = hashJoin(titles, disk, emit);
+            else if (op == 1)
+                matches[op] = indexNestedLoopJoin(titles, disk, ratingsIndex, emit);
+            else
+                matches[op] = sortMergeJoin(titles, disk, emit);
+            end = std::chrono::high_resolution_clock::now();
+            elapsed[op] = std::chrono::duration<double, std::milli>(end - start).count();
+            checksums[op] = checksum;
+        }
+
+        printHeader(std::to_string(numTitles) + " titles joined with " + std::to_string(disk.totalRecords()) + " ratings");
+        printKeyValue("Joined pairs", std::to_string(matches[0]));
+        printKeyValue("Hash join", std::to_string(elapsed[0]) + " milliseconds");
+        printKeyValue("Index nested-loop join", std::to_string(elapsed[1]) + " milliseconds");
+        printKeyValue("Sort-merge join", std::to_string(elapsed[2]) + " milliseconds");
+        bool agree = matches[0] == matches[1] && matches[1] == matches[2] &&
+                     std::fabs(checksums[0] - checksums[1]) < 1e-6 * std::max(1.0, checksums[0]) &&
+                     std::fabs(checksums[0] - checksums[2]) < 1e-6 * std::max(1.0, checksums[0]);
+        printKeyValue("Results agree", agree ? "yes" : "no");
+
+        if (numTitles == allTitles.size())
+            break;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <vector>
+#include <functional>
+#include "Storage.h"
+#include "Title.h"
+#include "HashIndex.h"
+
+// Receives every (rating, title) pair with equal tconst
+typedef std::function<void(const Record &, const TitleRecord &)> JoinCallback;
+
+// In-memory hash join: a HashIndex is built on the smaller input and probed with the other.
+// Returns the number of joined pairs.
+size_t hashJoin(const std::vector<const TitleRecord *> &titles, const SimulatedDisk &ratings, const JoinCallback &emit);
+
+// Index nested-loop join: one probe of an existing tconst index on the ratings per title
+size_t indexNestedLoopJoin(const std::vector<const TitleRecord *> &titles, const SimulatedDisk &ratings, const HashIndex &ratingsIndex, const JoinCallback &emit);
+
+// Sort-merge join: both inputs sorted on tconst, then merged in one pass
+size_t sortMergeJoin(const std::vector<const TitleRecord *> &titles, const SimulatedDisk &ratings, const JoinCallback &emit);
+
+// Join the ratings with title.basics.tsv on tconst using the three operators, for growing numbers of titles
+void experimentJoins(SimulatedDisk &disk, const std::string &titlesFilename);
+
+#endif // JOIN_H
@@ -0,0 +1,436 @@
+#include "PrefixBPlusTree.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+// Fixed-width layout (no compression), same accounting as the numVotes tree:
+// size of node = 2 + 4 + 10N + 8(N+1), 10 bytes being sizeof(Record::tconst)
+// Compressed layout adds a 1 byte prefix length plus the prefix bytes, and
+// stores every key as a 1 byte length followed by its suffix.
+//
+// Every entry keeps its 8 byte pointer either way, so an entry shrinks from 18 bytes
+// to at best 9 (an empty suffix): compression can at most double the fanout. For
+// tconst keys the suffixes are 1 to 3 bytes, so full 200 byte leaves go from 10 keys
+// to about 16, around 1.6 times the fanout.
+static const size_t NODE_HEADER_BYTES = 2 + 4;
+static const size_t POINTER_BYTES = 8;
+static const size_t FIXED_KEY_BYTES = sizeof(((Record *)0)->tconst);
+
+StringNode::StringNode(bool isLeaf) : IS_LEAF(isLeaf), next(nullptr) {}
+
+size_t StringNode::size() const
+{
+    return suffix.size();
+}
+
+std::string StringNode::keyAt(size_t i) const
+{
+    return prefix + suffix[i];
+}
+
+PrefixBPlusTree::PrefixBPlusTree(bool prefixCompression)
+    : root(nullptr), prefixCompression(prefixCompression), nodes(0), levels(0), numKeys(0) {}
+
+PrefixBPlusTree::~PrefixBPlusTree()
+{
+    deallocate(root);
+}
+
+void PrefixBPlusTree::deallocate(StringNode *node)
+{
+    if (node == nullptr)
+        return;
+    if (!node->IS_LEAF)
+    {
+        for (StringNode *child : node->ptr)
+            deallocate(child);
+    }
+    delete node;
+}
+
+// Bytes of a node of count keys, keyBytes being their total length with the prefix
+size_t PrefixBPlusTree::packedSize(size_t count, size_t keyBytes, size_t prefixLength, bool isLeaf) const
+{
+    size_t bytes = NODE_HEADER_BYTES;
+    if (prefixCompression)
+        bytes += 1 + prefixLength + count + keyBytes - count * prefixLength;
+    else
+        bytes += count * FIXED_KEY_BYTES;
+    if (isLeaf)
+        bytes += count * POINTER_BYTES + POINTER_BYTES; // records + next leaf
+    else
+        bytes += (count + 1) * POINTER_BYTES;
+    return bytes;
+}
+
+size_t PrefixBPlusTree::encodedSize(const StringNode *node) const
+{
+    size_t keyBytes = node->size() * node->prefix.size();
+    for (const std::string &s : node->suffix)
+        keyBytes += s.size();
+    return packedSize(node->size(), keyBytes, node->prefix.size(), node->IS_LEAF);
+}
+
+// Length of the common prefix of two keys, which for sorted keys is shared by every key between them
+static size_t commonPrefix(const std::string &a, const std::string &b)
+{
+    size_t length = 0;
+    while (length < a.size() && length < b.size() && a[length] == b[length])
+        ++length;
+    return length;
+}
+
+// Re-encode a node from its full, sorted keys
+void PrefixBPlusTree::setKeys(StringNode *node, const std::vector<std::string> &keys)
+{
+    size_t prefixLength = 0;
+    if (prefixCompression && !keys.empty())
+        prefixLength = commonPrefix(keys.front(), keys.back());
+    node->prefix = keys.empty() ? std::string() : keys.front().substr(0, prefixLength);
+    node->suffix.clear();
+    for (const std::string &key : keys)
+        node->suffix.push_back(key.substr(prefixLength));
+}
+
+std::vector<std::string> PrefixBPlusTree::getKeys(const StringNode *node) const
+{
+    std::vector<std::string> keys;
+    keys.reserve(node->size());
+    for (size_t i = 0; i < node->size(); ++i)
+        keys.push_back(node->keyAt(i));
+    return keys;
+}
+
+// Number of entries in the node whose key is <= key
+size_t PrefixBPlusTree::upperBound(const StringNode *node, const std::string &key) const
+{
+    const std::string &prefix = node->prefix;
+    int cmp = key.compare(0, prefix.size(), prefix);
+    if (cmp < 0)
+        return 0;
+    if (cmp > 0)
+        return node->size();
+
+    // key starts with the node prefix, only the suffixes need comparing
+    size_t lo = 0, hi = node->size();
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (key.compare(prefix.size(), std::string::npos, node->suffix[mid]) < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// Shortest separator s with leftLast < s <= rightFirst (suffix truncation)
+std::string PrefixBPlusTree::separator(const std::string &leftLast, const std::string &rightFirst) const
+{
+    if (!prefixCompression)
+        return rightFirst;
+    size_t length = commonPrefix(leftLast, rightFirst);
+    return rightFirst.substr(0, std::min(length + 1, rightFirst.size()));
+}
+
+void PrefixBPlusTree::insertKey(const std::string &key, unsigned char *record)
+{
+    if (root == nullptr)
+    {
+        root = new StringNode(true);
+        setKeys(root, std::vector<std::string>(1, key));
+        root->records.push_back(record);
+        ++nodes;
+        ++levels;
+        ++numKeys;
+        return;
+    }
+
+    std::vector<StringNode *> path; // internal nodes from the root down
+    StringNode *curNode = root;
+    while (!curNode->IS_LEAF)
+    {
+        path.push_back(curNode);
+        curNode = curNode->ptr[upperBound(curNode, key)];
+    }
+
+    size_t insertIndex = upperBound(curNode, key);
+    if (insertIndex > 0 && curNode->keyAt(insertIndex - 1) == key)
+    {
+        curNode->records[insertIndex - 1] = record; // tconst is unique, replace the record
+        return;
+    }
+
+    std::vector<std::string> keys = getKeys(curNode);
+    keys.insert(keys.begin() + insertIndex, key);
+    setKeys(curNode, keys);
+    curNode->records.insert(curNode->records.begin() + insertIndex, record);
+    ++numKeys;
+
+    if (encodedSize(curNode) > (size_t)BLOCK_SIZE)
+    {
+        splitLeafNode(curNode, path);
+    }
+}
+
+void PrefixBPlusTree::splitLeafNode(StringNode *leaf, std::vector<StringNode *> &path)
+{
+    StringNode *newLeaf = new StringNode(true);
+    ++nodes;
+
+    std::vector<std::string> keys = getKeys(leaf);
+    size_t mid = keys.size() / 2;
+    std::vector<std::string> leftKeys(keys.begin(), keys.begin() + mid);
+    std::vector<std::string> rightKeys(keys.begin() + mid, keys.end());
+
+    newLeaf->records.assign(leaf->records.begin() + mid, leaf->records.end());
+    leaf->records.resize(mid);
+    setKeys(leaf, leftKeys);
+    setKeys(newLeaf, rightKeys);
+
+    newLeaf->next = leaf->next;
+    leaf->next = newLeaf;
+
+    std::string sep = separator(leftKeys.back(), rightKeys.front());
+    if (path.empty())
+        createNewRoot(sep, leaf, newLeaf);
+    else
+        insertInternal(sep, newLeaf, path);
+}
+
+void PrefixBPlusTree::createNewRoot(const std::string &sep, StringNode *leftChild, StringNode *rightChild)
+{
+    StringNode *newRoot = new StringNode(false);
+    setKeys(newRoot, std::vector<std::string>(1, sep));
+    newRoot->ptr.push_back(leftChild);
+    newRoot->ptr.push_back(rightChild);
+    root = newRoot;
+    ++nodes;
+    ++levels;
+}
+
+void PrefixBPlusTree::insertInternal(const std::string &sep, StringNode *child, std::vector<StringNode *> &path)
+{
+    StringNode *parent = path.back();
+    path.pop_back();
+
+    size_t pos = upperBound(parent, sep);
+    std::vector<std::string> keys = getKeys(parent);
+    keys.insert(keys.begin() + pos, sep);
+    setKeys(parent, keys);
+    parent->ptr.insert(parent->ptr.begin() + pos + 1, child);
+
+    if (encodedSize(parent) <= (size_t)BLOCK_SIZE)
+        return;
+
+    // Split the internal node, the middle separator moves up
+    StringNode *splitNode = new StringNode(false);
+    ++nodes;
+    size_t mid = keys.size() / 2;
+    std::string up = keys[mid];
+    std::vector<std::string> leftKeys(keys.begin(), keys.begin() + mid);
+    std::vector<std::string> rightKeys(keys.begin() + mid + 1, keys.end());
+
+    splitNode->ptr.assign(parent->ptr.begin() + mid + 1, parent->ptr.end());
+    parent->ptr.resize(mid + 1);
+    setKeys(parent, leftKeys);
+    setKeys(splitNode, rightKeys);
+
+    if (path.empty())
+        createNewRoot(up, parent, splitNode);
+    else
+        insertInternal(up, splitNode, path);
+}
+
+// Number of keys from keys[first] on that fit one node, at least one
+size_t PrefixBPlusTree::packCount(const std::vector<std::string> &keys, size_t first, bool isLeaf) const
+{
+    if (first >= keys.size())
+        return 0;
+    size_t count = 1;
+    size_t keyBytes = keys[first].size();
+    while (first + count < keys.size())
+    {
+        const std::string &next = keys[first + count];
+        size_t prefixLength = prefixCompression ? commonPrefix(keys[first], next) : 0;
+        if (packedSize(count + 1, keyBytes + next.size(), prefixLength, isLeaf) > (size_t)BLOCK_SIZE)
+            break;
+        keyBytes += next.size();
+        ++count;
+    }
+    return count;
+}
+
+bool PrefixBPlusTree::bulkLoad(const std::vector<std::pair<std::string, unsigned char *>> &sorted)
+{
+    if (root != nullptr)
+        return false;
+    for (size_t i = 1; i < sorted.size(); ++i)
+    {
+        if (!(sorted[i - 1].first < sorted[i].first))
+            return false;
+    }
+    if (sorted.empty())
+        return true;
+
+    // Leaves, each holding as many keys as fit
+    std::vector<std::string> keys;
+    keys.reserve(sorted.size());
+    for (const std::pair<std::string, unsigned char *> &entry : sorted)
+        keys.push_back(entry.first);
+    std::vector<StringNode *> level;
+    std::vector<std::string> firstKeys, lastKeys; // key range of every node of the level
+    for (size_t first = 0; first < keys.size();)
+    {
+        size_t count = packCount(keys, first, true);
+        StringNode *leaf = new StringNode(true);
+        setKeys(leaf, std::vector<std::string>(keys.begin() + first, keys.begin() + first + count));
+        for (size_t i = first; i < first + count; ++i)
+            leaf->records.push_back(sorted[i].second);
+        if (!level.empty())
+            level.back()->next = leaf;
+        level.push_back(leaf);
+        firstKeys.push_back(keys[first]);
+        lastKeys.push_back(keys[first + count - 1]);
+        first += count;
+    }
+    nodes = (int)level.size();
+    levels = 1;
+    numKeys = (int)keys.size();
+
+    // Internal levels over the separators between neighbouring nodes
+    while (level.size() > 1)
+    {
+        std::vector<std::string> separators; // separators[i] lies between node i and node i + 1
+        for (size_t i = 1; i < level.size(); ++i)
+            separators.push_back(separator(lastKeys[i - 1], firstKeys[i]));
+
+        std::vector<StringNode *> parents;
+        std::vector<std::string> parentFirst, parentLast;
+        for (size_t first = 0; first < level.size();)
+        {
+            // count separators and count + 1 children; never leave a single child for the last node
+            size_t count = packCount(separators, first, false);
+            if (level.size() - (first + count + 1) == 1 && count > 1)
+                --count;
+            StringNode *parent = new StringNode(false);
+            setKeys(parent, std::vector<std::string>(separators.begin() + first, separators.begin() + first + count));
+            parent->ptr.assign(level.begin() + first, level.begin() + first + count + 1);
+            parents.push_back(parent);
+            parentFirst.push_back(firstKeys[first]);
+            parentLast.push_back(lastKeys[first + count]);
+            first += count + 1;
+        }
+        nodes += (int)parents.size();
+        ++levels;
+        level.swap(parents);
+        firstKeys.swap(parentFirst);
+        lastKeys.swap(parentLast);
+    }
+    root = level[0];
+    return true;
+}
+
+unsigned char *PrefixBPlusTree::search(const std::string &key) const
+{
+    if (root == nullptr)
+        return nullptr;
+
+    const StringNode *curNode = root;
+    while (!curNode->IS_LEAF)
+    {
+        curNode = curNode->ptr[upperBound(curNode, key)];
+    }
+
+    size_t pos = upperBound(curNode, key);
+    if (pos > 0 && curNode->keyAt(pos - 1) == key)
+        return curNode->records[pos - 1];
+    return nullptr;
+}
+
+int PrefixBPlusTree::getNodes() const
+{
+    return nodes;
+}
+
+int PrefixBPlusTree::getLevels() const
+{
+    return levels;
+}
+
+int PrefixBPlusTree::getNumKeys() const
+{
+    return numKeys;
+}
+
+double PrefixBPlusTree::averageLeafKeys() const
+{
+    if (root == nullptr)
+        return 0.0;
+    const StringNode *curNode = root;
+    while (!curNode->IS_LEAF)
+        curNode = curNode->ptr[0];
+
+    size_t leaves = 0, keys = 0;
+    for (; curNode != nullptr; curNode = curNode->next)
+    {
+        ++leaves;
+        keys += curNode->size();
+    }
+    return (double)keys / leaves;
+}
+
+void experimentPrefixCompression(SimulatedDisk &disk)
+{
+    // Both trees are bulk loaded from the sorted keys, so every node is as full as its
+    // encoding allows and the comparison does not depend on how inserts split nodes
+    // tconst is unique; like insertKey, the last record of a repeated key wins
+    std::vector<std::pair<std::string, unsigned char *>> unique;
+    for (Record *record : disk.sortedLiveRecords(SORT_BY_TCONST))
+    {
+        std::string tconst(record->tconst);
+        if (!unique.empty() && unique.back().first == tconst)
+            unique.back().second = reinterpret_cast<unsigned char *>(record);
+        else
+            unique.push_back(std::make_pair(tconst, reinterpret_cast<unsigned char *>(record)));
+    }
+
+    PrefixBPlusTree compressed(true);
+    PrefixBPlusTree fixedWidth(false);
+    compressed.bulkLoad(unique);
+    fixedWidth.bulkLoad(unique);
+    std::vector<std::string> probes;
+    for (const std::pair<std::string, unsigned char *> &entry : unique)
+        probes.push_back(entry.first);
+
+    std::mt19937 rng(3020);
+    std::shuffle(probes.begin(), probes.end(), rng);
+    if (probes.size() > 100000)
+        probes.resize(100000);
+
+    PrefixBPlusTree *trees[2] = {&fixedWidth, &compressed};
+    const char *names[2] = {"Fixed-width tconst keys", "Prefix-compressed tconst keys"};
+    for (int t = 0; t < 2; t++)
+    {
+        int found = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const std::string &key : probes)
+        {
+            if (trees[t]->search(key) != nullptr)
+                found++;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::nano> duration = end - start;
+        double perLookup = probes.empty() ? 0.0 : duration.count() / probes.size();
+
+        printHeader(names[t]);
+        printKeyValue("Number of keys", std::to_string(trees[t]->getNumKeys()));
+        printKeyValue("Number of nodes", std::to_string(trees[t]->getNodes()));
+        printKeyValue("Number of levels", std::to_string(trees[t]->getLevels()));
+        printKeyValue("Average keys per leaf", std::to_string(trees[t]->averageLeafKeys()));
+        printKeyValue("Lookups (found)", std::to_string(probes.size()) + " (" + std::to_string(found) + ")");
+        printKeyValue("Average lookup latency", std::to_string(perLookup) + " ns");
+    }
+    if (fixedWidth.averageLeafKeys() > 0)
+        printKeyValue("Leaf fanout gain", std::to_string(compressed.averageLeafKeys() / fixedWidth.averageLeafKeys()) + "x (at most 2x with 8 byte pointers)");
+}
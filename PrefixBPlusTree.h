@@ -0,0 +1,68 @@
+#ifndef PREFIXBPLUSTREE_H
+#define PREFIXBPLUSTREE_H
+
+#include <string>
+#include <vector>
+#include "Storage.h"
+
+// Node of the tconst-keyed B+ tree.
+// With prefix compression the longest common prefix of the keys in a node
+// is stored once and every entry only keeps the remaining suffix.
+class StringNode
+{
+public:
+    bool IS_LEAF;
+    std::string prefix;                   // common prefix of every key in the node
+    std::vector<std::string> suffix;      // keys (separators for internal nodes) without the prefix
+    std::vector<StringNode *> ptr;        // child pointers, internal nodes only (size + 1 entries)
+    std::vector<unsigned char *> records; // record pointers, leaf nodes only
+    StringNode *next;                     // next leaf node in key order
+
+    StringNode(bool isLeaf);
+    size_t size() const;
+    std::string keyAt(size_t i) const;
+};
+
+// B+ tree over the tconst column. Nodes are sized against BLOCK_SIZE in bytes
+// rather than a fixed key count, so shorter encoded keys raise the fanout.
+// Every entry still carries an 8 byte pointer, which caps the gain at twice the
+// fixed-width fanout; tconst keys get about 1.6 times.
+class PrefixBPlusTree
+{
+    StringNode *root;
+    bool prefixCompression;
+    int nodes;
+    int levels;
+    int numKeys;
+
+    size_t packedSize(size_t count, size_t keyBytes, size_t prefixLength, bool isLeaf) const;
+    size_t encodedSize(const StringNode *node) const;
+    size_t packCount(const std::vector<std::string> &keys, size_t first, bool isLeaf) const;
+    void setKeys(StringNode *node, const std::vector<std::string> &keys);
+    std::vector<std::string> getKeys(const StringNode *node) const;
+    size_t upperBound(const StringNode *node, const std::string &key) const;
+    std::string separator(const std::string &leftLast, const std::string &rightFirst) const;
+    void splitLeafNode(StringNode *leaf, std::vector<StringNode *> &path);
+    void insertInternal(const std::string &sep, StringNode *child, std::vector<StringNode *> &path);
+    void createNewRoot(const std::string &sep, StringNode *leftChild, StringNode *rightChild);
+    void deallocate(StringNode *node);
+
+public:
+    PrefixBPlusTree(bool prefixCompression = true);
+    ~PrefixBPlusTree();
+    void insertKey(const std::string &key, unsigned char *record);
+    // Build bottom-up from strictly increasing keys with every node filled as far as
+    // BLOCK_SIZE allows; only on an empty tree
+    bool bulkLoad(const std::vector<std::pair<std::string, unsigned char *>> &sorted);
+    unsigned char *search(const std::string &key) const;
+    int getNodes() const;
+    int getLevels() const;
+    int getNumKeys() const;
+    double averageLeafKeys() const;
+};
+
+// Bulk load the tconst index with and without prefix compression and compare
+// node count, levels and point lookup latency
+void experimentPrefixCompression(SimulatedDisk &disk);
+
+#endif // PREFIXBPLUSTREE_H
@@ -0,0 +1,291 @@
+#include "Query.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+// Records are fetched and filtered in batches of this many
+static const size_t BATCH_SIZE = 256;
+
+static double fieldValue(const Record &record, QueryField field)
+{
+    return field == FIELD_NUM_VOTES ? (double)record.numVotes : (double)record.averageRating;
+}
+
+static const char *fieldName(QueryField field)
+{
+    return field == FIELD_NUM_VOTES ? "numVotes" : "averageRating";
+}
+
+// averageRating is stored as a float, so its bounds are rounded the same way
+// to give the index path and the block scan identical answers
+Query &Query::between(QueryField field, double low, double high)
+{
+    if (field == FIELD_AVERAGE_RATING)
+    {
+        low = (float)low;
+        high = (float)high;
+    }
+    conjuncts.push_back({field, low, high});
+    return *this;
+}
+
+Query &Query::equals(QueryField field, double value)
+{
+    return between(field, value, value);
+}
+
+Query &Query::atLeast(QueryField field, double value)
+{
+    return between(field, value, std::numeric_limits<double>::infinity());
+}
+
+Query &Query::atMost(QueryField field, double value)
+{
+    return between(field, -std::numeric_limits<double>::infinity(), value);
+}
+
+const std::vector<Conjunct> &Query::getConjuncts() const
+{
+    return conjuncts;
+}
+
+bool Query::matches(const Record &record) const
+{
+    for (const Conjunct &conjunct : conjuncts)
+    {
+        double value = fieldValue(record, conjunct.field);
+        if (value < conjunct.low || value > conjunct.high)
+            return false;
+    }
+    return true;
+}
+
+std::string Query::describe() const
+{
+    std::string text;
+    for (const Conjunct &conjunct : conjuncts)
+    {
+        if (!text.empty())
+            text += " AND ";
+        std::ostringstream part;
+        part << fieldName(conjunct.field);
+        if (conjunct.low == conjunct.high)
+            part << " = " << conjunct.low;
+        else if (std::isinf(conjunct.high))
+            part << " >= " << conjunct.low;
+        else if (std::isinf(conjunct.low))
+            part << " <= " << conjunct.high;
+        else
+            part << " BETWEEN " << conjunct.low << " AND " << conjunct.high;
+        text += part.str();
+    }
+    return text.empty() ? "all records" : text;
+}
+
+AggregateResult::AggregateResult()
+    : count(0), sum(0.0), min(std::numeric_limits<double>::infinity()), max(-std::numeric_limits<double>::infinity()) {}
+
+double AggregateResult::avg() const
+{
+    return count > 0 ? sum / count : 0.0;
+}
+
+QueryStats::QueryStats() : path(SEQUENTIAL_SCAN), recordsFetched(0), recordsMatched(0) {}
+
+// Keeps the records of in[0..n) that satisfy every conjunct, writing them to out.
+// Each conjunct is one pass over a column of values gathered from the batch, and
+// the selection is kept as a byte mask, so the inner loops have no branches.
+static size_t filterBatch(const Record *const *in, size_t n, const std::vector<Conjunct> &conjuncts, const Record **out)
+{
+    unsigned char keep[BATCH_SIZE];
+    double values[BATCH_SIZE];
+    std::fill(keep, keep + n, (unsigned char)1);
+    for (const Conjunct &conjunct : conjuncts)
+    {
+        if (conjunct.field == FIELD_NUM_VOTES)
+        {
+            for (size_t i = 0; i < n; i++)
+                values[i] = in[i]->numVotes;
+        }
+        else
+        {
+            for (size_t i = 0; i < n; i++)
+                values[i] = in[i]->averageRating;
+        }
+        const double low = conjunct.low, high = conjunct.high;
+        for (size_t i = 0; i < n; i++)
+            keep[i] &= (unsigned char)((values[i] >= low) & (values[i] <= high));
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        out[kept] = in[i];
+        kept += keep[i];
+    }
+    return kept;
+}
+
+QueryExecutor::QueryExecutor(const BPlusTree &votesIndex, const SimulatedDisk &disk, const ColumnStatistics &votesStats)
+    : votesIndex(votesIndex), disk(disk), votesStats(votesStats) {}
+
+void QueryExecutor::run(const Query &query, const std::function<void(const Record *const *, size_t)> &onBatch, QueryStats *stats) const
+{
+    QueryStats local;
+    QueryStats &counters = stats ? *stats : local;
+    counters = QueryStats();
+
+    // Collapse the conjuncts into one range per column
+    double votesLow = -std::numeric_limits<double>::infinity(), votesHigh = std::numeric_limits<double>::infinity();
+    double ratingLow = -std::numeric_limits<double>::infinity(), ratingHigh = std::numeric_limits<double>::infinity();
+    bool hasVotes = false;
+    std::vector<Conjunct> residual;
+    for (const Conjunct &conjunct : query.getConjuncts())
+    {
+        if (conjunct.field == FIELD_NUM_VOTES)
+        {
+            votesLow = std::max(votesLow, conjunct.low);
+            votesHigh = std::min(votesHigh, conjunct.high);
+            hasVotes = true;
+        }
+        else
+        {
+            ratingLow = std::max(ratingLow, conjunct.low);
+            ratingHigh = std::min(ratingHigh, conjunct.high);
+            residual.push_back(conjunct);
+        }
+    }
+    int minVotes = votesLow <= INT_MIN ? INT_MIN : (int)std::ceil(votesLow);
+    int maxVotes = votesHigh >= INT_MAX ? INT_MAX : (int)std::floor(votesHigh);
+    if (votesLow > votesHigh || ratingLow > ratingHigh || minVotes > maxVotes)
+        return;
+
+    // numVotes is the only indexed column, so it is the conjunct the index can answer.
+    // The planner decides whether probing it beats scanning the blocks.
+    if (hasVotes && votesStats.getTotalRows() > 0)
+    {
+        QueryPlanner planner(votesStats, votesIndex, disk);
+        counters.path = planner.plan(minVotes, maxVotes).path;
+    }
+
+    const Record *batch[BATCH_SIZE];
+    const Record *matched[BATCH_SIZE];
+    if (counters.path == INDEX_SCAN)
+    {
+        std::vector<unsigned char *> records = votesIndex.rangeSearch(minVotes, maxVotes);
+        counters.recordsFetched = records.size();
+        for (size_t start = 0; start < records.size(); start += BATCH_SIZE)
+        {
+            size_t n = std::min(BATCH_SIZE, records.size() - start);
+            for (size_t i = 0; i < n; i++)
+                batch[i] = reinterpret_cast<const Record *>(records[start + i]);
+            size_t kept = residual.empty() ? n : filterBatch(batch, n, residual, matched);
+            if (kept > 0)
+                onBatch(residual.empty() ? batch : matched, kept);
+        }
+        return;
+    }
+
+    // The block scan prunes with the zone maps and evaluates every conjunct itself
+    ScanPredicate predicate;
+    predicate.minVotes = minVotes;
+    predicate.maxVotes = maxVotes;
+    predicate.minRating = std::isinf(ratingLow) ? -std::numeric_limits<float>::max() : (float)ratingLow;
+    predicate.maxRating = std::isinf(ratingHigh) ? std::numeric_limits<float>::max() : (float)ratingHigh;
+    ScanStats scanStats;
+    size_t n = 0;
+    disk.scan(predicate, [&](const Record &record) {
+        batch[n++] = &record;
+        if (n == BATCH_SIZE)
+        {
+            onBatch(batch, n);
+            n = 0;
+        }
+    }, scanStats);
+    if (n > 0)
+        onBatch(batch, n);
+    counters.recordsFetched = scanStats.recordsAccessed; // matches are counted by select and aggregate
+}
+
+std::vector<const Record *> QueryExecutor::select(const Query &query, QueryStats *stats) const
+{
+    std::vector<const Record *> result;
+    run(query, [&result](const Record *const *records, size_t n) {
+        result.insert(result.end(), records, records + n);
+    }, stats);
+    if (stats)
+        stats->recordsMatched = result.size();
+    return result;
+}
+
+AggregateResult QueryExecutor::aggregate(const Query &query, QueryField field, QueryStats *stats) const
+{
+    AggregateResult result;
+    run(query, [&result, field](const Record *const *records, size_t n) {
+        for (size_t i = 0; i < n; i++)
+        {
+            double value = fieldValue(*records[i], field);
+            result.sum += value;
+            result.min = std::min(result.min, value);
+            result.max = std::max(result.max, value);
+        }
+        result.count += n;
+    }, stats);
+    if (stats)
+        stats->recordsMatched = result.count;
+    return result;
+}
+
+void experimentMultiPredicateQueries(BPlusTree &tree, SimulatedDisk &disk, const ColumnStatistics &stats)
+{
+    if (stats.getTotalRows() == 0)
+    {
+        std::cout << "No column statistics, run experiment 2 first" << std::endl;
+        return;
+    }
+
+    QueryExecutor executor(tree, disk, stats);
+    std::vector<Query> queries;
+    queries.push_back(Query().between(FIELD_NUM_VOTES, 30000, 40000).atLeast(FIELD_AVERAGE_RATING, 7.0));
+    queries.push_back(Query().equals(FIELD_NUM_VOTES, 500).between(FIELD_AVERAGE_RATING, 5.0, 7.0));
+    queries.push_back(Query().between(FIELD_NUM_VOTES, 100, 1000).atLeast(FIELD_AVERAGE_RATING, 8.5));
+    queries.push_back(Query().atLeast(FIELD_AVERAGE_RATING, 9.5));
+    queries.push_back(Query().atLeast(FIELD_NUM_VOTES, 100000).atMost(FIELD_AVERAGE_RATING, 6.0));
+
+    for (const Query &query : queries)
+    {
+        QueryStats queryStats;
+        auto start = std::chrono::high_resolution_clock::now();
+        AggregateResult ratings = executor.aggregate(query, FIELD_AVERAGE_RATING, &queryStats);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> duration = end - start;
+
+        // Reference answer: every record, every conjunct
+        AggregateResult expected;
+        for (const Block &block : disk.getBlocks())
+        {
+            for (const Record &record : block.records)
+            {
+                if (record.isDeleted() || !query.matches(record))
+                    continue;
+                expected.count++;
+                expected.sum += record.averageRating;
+            }
+        }
+
+        printHeader(query.describe());
+        printKeyValue("Access path", queryStats.path == INDEX_SCAN ? "index scan on numVotes" : "sequential scan");
+        printKeyValue("Records fetched", std::to_string(queryStats.recordsFetched));
+        printKeyValue("COUNT(*)", std::to_string(ratings.count));
+        if (ratings.count > 0)
+        {
+            printKeyValue("AVG(averageRating)", std::to_string(ratings.avg()));
+            printKeyValue("MIN(averageRating)", std::to_string(ratings.min));
+            printKeyValue("MAX(averageRating)", std::to_string(ratings.max));
+        }
+        printKeyValue("Running time", std::to_string(duration.count()) + " milliseconds");
+        printKeyValue("Matches full scan", expected.count == ratings.count && std::fabs(expected.sum - ratings.sum) < 1e-3 ? "yes" : "no");
+    }
+}
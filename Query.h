@@ -0,0 +1,83 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <vector>
+#include <string>
+#include "Storage.h"
+#include "BPlusTree.h"
+#include "QueryPlanner.h"
+
+// Record columns a query can filter or aggregate on
+enum QueryField
+{
+    FIELD_NUM_VOTES,
+    FIELD_AVERAGE_RATING
+};
+
+// One conjunct: low <= field <= high
+struct Conjunct
+{
+    QueryField field;
+    double low;
+    double high;
+};
+
+// Conjunction of range predicates over Record fields, built by chaining:
+// Query().between(FIELD_NUM_VOTES, 1000, 5000).atLeast(FIELD_AVERAGE_RATING, 7.5)
+class Query
+{
+    std::vector<Conjunct> conjuncts;
+
+public:
+    Query &between(QueryField field, double low, double high);
+    Query &equals(QueryField field, double value);
+    Query &atLeast(QueryField field, double value);
+    Query &atMost(QueryField field, double value);
+    const std::vector<Conjunct> &getConjuncts() const;
+    bool matches(const Record &record) const;
+    std::string describe() const;
+};
+
+// count, sum, avg, min and max of one field over the matching records
+struct AggregateResult
+{
+    size_t count;
+    double sum;
+    double min;
+    double max;
+
+    AggregateResult();
+    double avg() const;
+};
+
+// Per-query counters
+struct QueryStats
+{
+    AccessPath path;
+    size_t recordsFetched; // records read from the index or the unpruned blocks
+    size_t recordsMatched;
+
+    QueryStats();
+};
+
+// Runs queries through the numVotes B+ tree when the planner prefers it, otherwise
+// through the block scan. Conjuncts the access path does not answer are evaluated
+// over batches of fetched records.
+class QueryExecutor
+{
+    const BPlusTree &votesIndex;
+    const SimulatedDisk &disk;
+    const ColumnStatistics &votesStats;
+
+    void run(const Query &query, const std::function<void(const Record *const *, size_t)> &onBatch, QueryStats *stats) const;
+
+public:
+    QueryExecutor(const BPlusTree &votesIndex, const SimulatedDisk &disk, const ColumnStatistics &votesStats);
+    std::vector<const Record *> select(const Query &query, QueryStats *stats = nullptr) const;
+    AggregateResult aggregate(const Query &query, QueryField field, QueryStats *stats = nullptr) const;
+};
+
+// Multi-predicate queries over numVotes and averageRating, checked against a plain scan of every record
+void experimentMultiPredicateQueries(BPlusTree &tree, SimulatedDisk &disk, const ColumnStatistics &stats);
+
+#endif // QUERY_H
@@ -0,0 +1,212 @@
+#include "QueryPlanner.h"
+#include <chrono>
+#include <cmath>
+#include <set>
+
+// Cost units: a sequential block read costs 1, a random block read RANDOM_BLOCK_COST
+static const double RANDOM_BLOCK_COST = 4.0;
+
+ColumnStatistics::ColumnStatistics() : totalRows(0), distinctValues(0), clustered(false) {}
+
+void ColumnStatistics::build(const SimulatedDisk &disk, int numBuckets)
+{
+    std::vector<int> values;
+    values.reserve(disk.totalRecords());
+    for (const Block &block : disk.getBlocks())
+    {
+        for (const Record &record : block.records)
+        {
+            if (!record.isDeleted())
+                values.push_back(record.numVotes);
+        }
+    }
+    clustered = std::is_sorted(values.begin(), values.end());
+    std::sort(values.begin(), values.end());
+
+    buckets.clear();
+    totalRows = values.size();
+    distinctValues = 0;
+    if (values.empty())
+    {
+        return;
+    }
+
+    // Equal row counts per bucket, but a value is never split over two buckets
+    size_t target = (values.size() + numBuckets - 1) / numBuckets;
+    size_t i = 0;
+    while (i < values.size())
+    {
+        Bucket bucket;
+        bucket.low = values[i];
+        bucket.rows = 0;
+        bucket.distinct = 0;
+        while (i < values.size() && (bucket.rows < target || values[i] == values[i - 1]))
+        {
+            if (bucket.rows == 0 || values[i] != values[i - 1])
+            {
+                bucket.distinct++;
+            }
+            bucket.high = values[i];
+            bucket.rows++;
+            i++;
+        }
+        distinctValues += bucket.distinct;
+        buckets.push_back(bucket);
+    }
+}
+
+// Rows are assumed to be spread evenly over the value range of their bucket
+double ColumnStatistics::estimateRows(int minVotes, int maxVotes) const
+{
+    double rows = 0.0;
+    for (const Bucket &bucket : buckets)
+    {
+        if (bucket.high < minVotes || bucket.low > maxVotes)
+            continue;
+        if (minVotes == maxVotes)
+            return (double)bucket.rows / bucket.distinct; // equality: average rows per distinct value
+        double lo = std::max(minVotes, bucket.low);
+        double hi = std::min(maxVotes, bucket.high);
+        rows += bucket.rows * (hi - lo + 1) / ((double)bucket.high - bucket.low + 1);
+    }
+    return rows;
+}
+
+double ColumnStatistics::estimateDistinct(int minVotes, int maxVotes) const
+{
+    double distinct = 0.0;
+    for (const Bucket &bucket : buckets)
+    {
+        if (bucket.high < minVotes || bucket.low > maxVotes)
+            continue;
+        double lo = std::max(minVotes, bucket.low);
+        double hi = std::min(maxVotes, bucket.high);
+        distinct += bucket.distinct * (hi - lo + 1) / ((double)bucket.high - bucket.low + 1);
+    }
+    return distinct;
+}
+
+size_t ColumnStatistics::getTotalRows() const
+{
+    return totalRows;
+}
+
+size_t ColumnStatistics::getDistinctValues() const
+{
+    return distinctValues;
+}
+
+bool ColumnStatistics::isClustered() const
+{
+    return clustered;
+}
+
+QueryPlanner::QueryPlanner(const ColumnStatistics &stats, const BPlusTree &tree, const SimulatedDisk &disk)
+    : stats(stats), tree(tree), disk(disk) {}
+
+QueryPlan QueryPlanner::plan(int minVotes, int maxVotes) const
+{
+    QueryPlan plan;
+    double blocks = (double)disk.totalBlocks();
+    double recordsPerBlock = (double)(BLOCK_SIZE / sizeof(Record));
+    plan.estimatedRows = stats.estimateRows(minVotes, maxVotes);
+    plan.selectivity = stats.getTotalRows() > 0 ? plan.estimatedRows / stats.getTotalRows() : 0.0;
+
+    // Index scan: descent, the leaves holding the matching keys, then the data blocks of the records
+    double keysPerLeaf = tree.leafCount() > 0 ? (double)tree.keyCount() / tree.leafCount() : 1.0;
+    double leaves = std::max(1.0, std::ceil(stats.estimateDistinct(minVotes, maxVotes) / keysPerLeaf));
+    double dataBlocks;
+    if (stats.isClustered())
+    {
+        dataBlocks = std::ceil(plan.estimatedRows / recordsPerBlock) + 1;
+    }
+    else
+    {
+        // Cardenas: expected distinct blocks touched by rows fetched at random
+        dataBlocks = blocks > 0 ? blocks * (1.0 - std::pow(1.0 - 1.0 / blocks, plan.estimatedRows)) : 0.0;
+    }
+    double dataBlockCost = stats.isClustered() ? 1.0 : RANDOM_BLOCK_COST;
+    plan.indexCost = RANDOM_BLOCK_COST * ((tree.height() - 1) + leaves) + dataBlockCost * dataBlocks;
+
+    // Sequential scan: every block the zone maps cannot rule out
+    int candidateBlocks = 0;
+    for (size_t i = 0; i < disk.totalBlocks(); i++)
+    {
+        if (disk.getSummary(i).zoneMap.mayContainVotes(minVotes, maxVotes))
+            candidateBlocks++;
+    }
+    plan.scanCost = candidateBlocks;
+
+    plan.path = plan.indexCost < plan.scanCost ? INDEX_SCAN : SEQUENTIAL_SCAN;
+    return plan;
+}
+
+void explainQuery(const ColumnStatistics &stats, const BPlusTree &tree, const SimulatedDisk &disk, int minVotes, int maxVotes)
+{
+    printHeader("Planner choice for numVotes between " + std::to_string(minVotes) + " and " + std::to_string(maxVotes));
+    if (stats.getTotalRows() == 0)
+    {
+        std::cout << "No column statistics, run experiment 2 first" << std::endl;
+        return;
+    }
+
+    QueryPlan plan = QueryPlanner(stats, tree, disk).plan(minVotes, maxVotes);
+    printKeyValue("Estimated rows (selectivity)", std::to_string((long)std::round(plan.estimatedRows)) + " (" + std::to_string(plan.selectivity) + ")");
+    printKeyValue("Estimated index scan cost", std::to_string((long)std::round(plan.indexCost)));
+    printKeyValue("Estimated sequential scan cost", std::to_string((long)std::round(plan.scanCost)));
+    printKeyValue("Chosen access path", plan.path == INDEX_SCAN ? "index scan" : "sequential scan");
+}
+
+void experimentQueryPlanner(BPlusTree &tree, SimulatedDisk &disk, const ColumnStatistics &stats)
+{
+    if (stats.getTotalRows() == 0)
+    {
+        std::cout << "No column statistics, run experiment 2 first" << std::endl;
+        return;
+    }
+
+    QueryPlanner planner(stats, tree, disk);
+    const int ranges[6][2] = {{500, 500}, {30000, 40000}, {1000, 10000}, {100, 1000}, {10, 100}, {1, 100000}};
+    for (const auto &range : ranges)
+    {
+        int minVotes = range[0], maxVotes = range[1];
+        QueryPlan plan = planner.plan(minVotes, maxVotes);
+
+        size_t rows = 0;
+        double actualCost = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (plan.path == INDEX_SCAN)
+        {
+            AccessStats access;
+            std::vector<unsigned char *> records = tree.rangeSearch(minVotes, maxVotes, &access);
+            std::set<long> dataBlocks;
+            for (unsigned char *recordPtr : records)
+            {
+                dataBlocks.insert(disk.blockIdOf(recordPtr));
+            }
+            rows = records.size();
+            double dataBlockCost = stats.isClustered() ? 1.0 : RANDOM_BLOCK_COST;
+            actualCost = RANDOM_BLOCK_COST * (access.indexNodes + access.leafNodes) + dataBlockCost * dataBlocks.size();
+        }
+        else
+        {
+            ScanPredicate predicate;
+            predicate.minVotes = minVotes;
+            predicate.maxVotes = maxVotes;
+            ScanStats scanStats;
+            disk.scan(predicate, [&rows](const Record &) { rows++; }, scanStats);
+            actualCost = scanStats.blocksAccessed;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> duration = end - start;
+
+        printHeader("numVotes between " + std::to_string(minVotes) + " and " + std::to_string(maxVotes));
+        printKeyValue("Estimated rows (selectivity)", std::to_string((long)std::round(plan.estimatedRows)) + " (" + std::to_string(plan.selectivity) + ")");
+        printKeyValue("Actual rows", std::to_string(rows));
+        printKeyValue("Estimated index scan cost", std::to_string((long)std::round(plan.indexCost)));
+        printKeyValue("Estimated sequential scan cost", std::to_string((long)std::round(plan.scanCost)));
+        printKeyValue("Chosen access path", plan.path == INDEX_SCAN ? "index scan" : "sequential scan");
+        printKeyValue("Actual cost", std::to_string((long)std::round(actualCost)));
+        printKeyValue("Running time", std::to_string(duration.count()) + " milliseconds");
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef QUERYPLANNER_H
+#define QUERYPLANNER_H
+
+#include <vector>
+#include <string>
+#include "Storage.h"
+#include "BPlusTree.h"
+
+// Equi-depth histogram and distinct count of the numVotes column
+class ColumnStatistics
+{
+    struct Bucket
+    {
+        int low;
+        int high;
+        size_t rows;
+        size_t distinct;
+    };
+
+    std::vector<Bucket> buckets;
+    size_t totalRows;
+    size_t distinctValues;
+    bool clustered; // data blocks are sorted on numVotes
+
+public:
+    ColumnStatistics();
+    void build(const SimulatedDisk &disk, int numBuckets = 64);
+    double estimateRows(int minVotes, int maxVotes) const;
+    double estimateDistinct(int minVotes, int maxVotes) const;
+    size_t getTotalRows() const;
+    size_t getDistinctValues() const;
+    bool isClustered() const;
+};
+
+enum AccessPath
+{
+    INDEX_SCAN,
+    SEQUENTIAL_SCAN
+};
+
+// Chosen access path with the estimates behind it.
+// Costs are in sequential block reads, a random block read counts as several.
+struct QueryPlan
+{
+    AccessPath path;
+    double estimatedRows;
+    double selectivity;
+    double indexCost;
+    double scanCost;
+};
+
+// Picks index or sequential scan for a numVotes range predicate
+class QueryPlanner
+{
+    const ColumnStatistics &stats;
+    const BPlusTree &tree;
+    const SimulatedDisk &disk;
+
+public:
+    QueryPlanner(const ColumnStatistics &stats, const BPlusTree &tree, const SimulatedDisk &disk);
+    QueryPlan plan(int minVotes, int maxVotes) const;
+};
+
+// Print the plan chosen for a numVotes range query without running it
+void explainQuery(const ColumnStatistics &stats, const BPlusTree &tree, const SimulatedDisk &disk, int minVotes, int maxVotes);
+
+// Plan and run numVotes range queries of different selectivity, printing estimated against actual cost
+void experimentQueryPlanner(BPlusTree &tree, SimulatedDisk &disk, const ColumnStatistics &stats);
+
+#endif // QUERYPLANNER_H
@@ -4,6 +4,7 @@
 
 #include <string>
 #include <cstring>
+#include <vector>
 
 struct Record {
     char tconst[10];     // 9 chars for the ID + 1 for null terminator
@@ -19,6 +20,11 @@ struct Record {
         numVotes = votes;
     }
 
+    // Deleted slots are zero filled, the same way unused slots are written to the data file
+    bool isDeleted() const {
+        return tconst[0] == '\0';
+    }
+
     std::vector<unsigned char> serializeRecord(const Record& record) {
         std::vector<unsigned char> buffer;
 
@@ -0,0 +1,372 @@
+#include "ShardedIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <random>
+#include <thread>
+
+ShardedIndex::ShardedIndex(int numShards) : requestedShards(std::max(1, numShards))
+{
+    shards.push_back(std::unique_ptr<BPlusTree>(new BPlusTree()));
+    shards.back()->setVerbose(false);
+    locks.push_back(std::unique_ptr<std::mutex>(new std::mutex()));
+}
+
+bool ShardedIndex::setBoundaries(std::vector<int> sampleKeys)
+{
+    // New boundaries would start from empty shards and drop every indexed record
+    for (const std::unique_ptr<BPlusTree> &shard : shards)
+    {
+        if (shard->keyCount() > 0)
+        {
+            std::cerr << "Shard boundaries can only be set while the index is empty" << std::endl;
+            return false;
+        }
+    }
+
+    boundaries.clear();
+    std::sort(sampleKeys.begin(), sampleKeys.end());
+    for (int i = 1; i < requestedShards && !sampleKeys.empty(); i++)
+    {
+        int boundary = sampleKeys[sampleKeys.size() * i / requestedShards];
+        if ((boundaries.empty() && boundary > sampleKeys.front()) || (!boundaries.empty() && boundary > boundaries.back()))
+            boundaries.push_back(boundary);
+    }
+
+    shards.clear();
+    locks.clear();
+    for (size_t i = 0; i <= boundaries.size(); i++)
+    {
+        shards.push_back(std::unique_ptr<BPlusTree>(new BPlusTree()));
+        shards.back()->setVerbose(false);
+        locks.push_back(std::unique_ptr<std::mutex>(new std::mutex()));
+    }
+    return true;
+}
+
+bool ShardedIndex::load(const std::vector<std::pair<int, unsigned char *>> &entries, size_t sampleSize)
+{
+    std::mt19937 rng(3020);
+    std::vector<int> sample;
+    for (size_t i = 0; i < sampleSize && !entries.empty(); i++)
+    {
+        sample.push_back(entries[rng() % entries.size()].first);
+    }
+    if (!setBoundaries(sample))
+        return false;
+
+    // Entries keep their order within a shard, so every posting list comes out the same
+    // as from inserting all entries into one tree
+    std::vector<std::vector<std::pair<int, unsigned char *>>> routed(shards.size());
+    for (const std::pair<int, unsigned char *> &entry : entries)
+    {
+        routed[shardOf(entry.first)].push_back(entry);
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        threads.push_back(std::thread([this, i, &routed]() {
+            for (const std::pair<int, unsigned char *> &entry : routed[i])
+            {
+                shards[i]->insertKey(entry.first, entry.second);
+            }
+        }));
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    return true;
+}
+
+int ShardedIndex::shardOf(int key) const
+{
+    return (int)(std::upper_bound(boundaries.begin(), boundaries.end(), key) - boundaries.begin());
+}
+
+void ShardedIndex::insertKey(int key, unsigned char *recordPtr)
+{
+    int i = shardOf(key);
+    std::lock_guard<std::mutex> lock(*locks[i]);
+    shards[i]->insertKey(key, recordPtr);
+}
+
+void ShardedIndex::deleteKey(int key)
+{
+    int i = shardOf(key);
+    std::lock_guard<std::mutex> lock(*locks[i]);
+    shards[i]->deleteKey(key);
+}
+
+// The records are copied out under the lock, since a posting list can change once it is released
+std::vector<unsigned char *> ShardedIndex::lookup(int key, AccessStats *stats) const
+{
+    int i = shardOf(key);
+    std::lock_guard<std::mutex> lock(*locks[i]);
+    std::vector<unsigned char *> records;
+    for (PostingIterator it = shards[i]->lookup(key, stats); it.valid(); ++it)
+    {
+        records.push_back(*it);
+    }
+    return records;
+}
+
+void ShardedIndex::rangeSearchShard(int i, int minKey, int maxKey, std::vector<unsigned char *> &out, AccessStats &stats) const
+{
+    std::lock_guard<std::mutex> lock(*locks[i]);
+    out = shards[i]->rangeSearch(minKey, maxKey, &stats);
+}
+
+std::vector<unsigned char *> ShardedIndex::rangeSearch(int minKey, int maxKey, AccessStats *stats) const
+{
+    if (minKey > maxKey)
+        return std::vector<unsigned char *>();
+    int first = shardOf(minKey);
+    int last = shardOf(maxKey);
+    std::vector<std::vector<unsigned char *>> parts(last - first + 1);
+    std::vector<AccessStats> partStats(parts.size());
+
+    // The calling thread takes the first shard, the others get a thread each
+    std::vector<std::thread> threads;
+    for (int i = first + 1; i <= last; i++)
+    {
+        threads.push_back(std::thread(&ShardedIndex::rangeSearchShard, this, i, minKey, maxKey,
+                                      std::ref(parts[i - first]), std::ref(partStats[i - first])));
+    }
+    rangeSearchShard(first, minKey, maxKey, parts[0], partStats[0]);
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const AccessStats &part : partStats)
+    {
+        if (stats == nullptr)
+            break;
+        stats->indexNodes += part.indexNodes;
+        stats->leafNodes += part.leafNodes;
+        stats->records += part.records;
+    }
+    if (parts.size() == 1)
+        return std::move(parts[0]);
+    size_t total = 0;
+    for (const std::vector<unsigned char *> &part : parts)
+    {
+        total += part.size();
+    }
+    std::vector<unsigned char *> result;
+    result.reserve(total);
+    for (const std::vector<unsigned char *> &part : parts)
+    {
+        result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+}
+
+int ShardedIndex::shardCount() const
+{
+    return (int)shards.size();
+}
+
+const std::vector<int> &ShardedIndex::getBoundaries() const
+{
+    return boundaries;
+}
+
+const BPlusTree &ShardedIndex::shard(int i) const
+{
+    return *shards[i];
+}
+
+void experimentShardedIndex(const SimulatedDisk &disk)
+{
+    if (disk.totalRecords() == 0)
+    {
+        std::cout << "The disk is empty, run experiment 1 first" << std::endl;
+        return;
+    }
+    const int numShards = 4;
+    const size_t sampleSize = 1000;
+    const int numThreads = 4;
+
+    std::vector<std::pair<int, unsigned char *>> entries = disk.numVotesEntries(false); // disk order
+
+    BPlusTree single;
+    single.setVerbose(false);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const std::pair<int, unsigned char *> &entry : entries)
+    {
+        single.insertKey(entry.first, entry.second);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> singleBuild = end - start;
+
+    ShardedIndex sharded(numShards);
+    start = std::chrono::high_resolution_clock::now();
+    sharded.load(entries, sampleSize);
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> shardedBuild = end - start;
+
+    printHeader("Sharded Index");
+    printKeyValue("Shards", std::to_string(sharded.shardCount()) + " (boundaries from a sample of " + std::to_string(sampleSize) + " keys)");
+    const std::vector<int> &boundaries = sharded.getBoundaries();
+    for (int i = 0; i < sharded.shardCount(); i++)
+    {
+        std::string range = (i == 0 ? std::string("(-inf") : "[" + std::to_string(boundaries[i - 1])) + ", " +
+                            (i == sharded.shardCount() - 1 ? std::string("+inf)") : std::to_string(boundaries[i]) + ")");
+        const BPlusTree &shard = sharded.shard(i);
+        printKeyValue("Shard " + std::to_string(i), range + ": " + std::to_string(shard.rangeSearch(INT_MIN, INT_MAX).size()) + " records, " +
+                                                        std::to_string(shard.keyCount()) + " keys, " + std::to_string(shard.height()) + " levels, " +
+                                                        std::to_string(shard.nodeCount()) + " nodes");
+    }
+    printKeyValue("Single tree", std::to_string(entries.size()) + " records, " + std::to_string(single.keyCount()) + " keys, " +
+                                     std::to_string(single.height()) + " levels, " + std::to_string(single.nodeCount()) + " nodes");
+    printKeyValue("Single tree build", std::to_string(singleBuild.count()) + " milliseconds");
+    printKeyValue("Sharded build", std::to_string(shardedBuild.count()) + " milliseconds, one thread per shard");
+
+    // Point lookups over the distinct keys, drawn uniformly
+    std::vector<int> distinctKeys;
+    for (const std::pair<int, unsigned char *> &entry : entries)
+    {
+        distinctKeys.push_back(entry.first);
+    }
+    std::sort(distinctKeys.begin(), distinctKeys.end());
+    distinctKeys.erase(std::unique(distinctKeys.begin(), distinctKeys.end()), distinctKeys.end());
+    std::mt19937 rng(3020);
+    std::vector<int> pointKeys;
+    for (int i = 0; i < 100000; i++)
+    {
+        pointKeys.push_back(distinctKeys[rng() % distinctKeys.size()]);
+    }
+
+    uintptr_t singleChecksum = 0, shardedChecksum = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int key : pointKeys)
+    {
+        for (PostingIterator it = single.lookup(key); it.valid(); ++it)
+        {
+            singleChecksum += reinterpret_cast<uintptr_t>(*it);
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> singleLookups = end - start;
+    start = std::chrono::high_resolution_clock::now();
+    for (int key : pointKeys)
+    {
+        for (unsigned char *record : sharded.lookup(key))
+        {
+            shardedChecksum += reinterpret_cast<uintptr_t>(record);
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> shardedLookups = end - start;
+
+    printHeader("Point lookups");
+    printKeyValue("Lookups", std::to_string(pointKeys.size()));
+    printKeyValue("Single tree", std::to_string((long)(pointKeys.size() / (singleLookups.count() / 1e9))) + " lookups/sec");
+    printKeyValue("Sharded", std::to_string((long)(pointKeys.size() / (shardedLookups.count() / 1e9))) + " lookups/sec");
+    printKeyValue("Same records", singleChecksum == shardedChecksum ? "yes" : "no");
+
+    // Narrow ranges mostly stay in one shard; wide ones span from the 10th to the 90th percentile key
+    auto compareRanges = [&](const std::string &label, const std::vector<std::pair<int, int>> &ranges) {
+        size_t records = 0;
+        bool sameOrder = true;
+        std::vector<std::vector<unsigned char *>> singleResults, shardedResults;
+        auto rangeStart = std::chrono::high_resolution_clock::now();
+        for (const std::pair<int, int> &range : ranges)
+        {
+            singleResults.push_back(single.rangeSearch(range.first, range.second));
+        }
+        auto rangeEnd = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::micro> singleDuration = rangeEnd - rangeStart;
+        rangeStart = std::chrono::high_resolution_clock::now();
+        int fannedOut = 0;
+        for (const std::pair<int, int> &range : ranges)
+        {
+            shardedResults.push_back(sharded.rangeSearch(range.first, range.second));
+            if (sharded.shardOf(range.first) != sharded.shardOf(range.second))
+                fannedOut++;
+        }
+        rangeEnd = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::micro> shardedDuration = rangeEnd - rangeStart;
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            records += singleResults[i].size();
+            sameOrder = sameOrder && singleResults[i] == shardedResults[i];
+        }
+
+        printHeader(label);
+        printKeyValue("Searches", std::to_string(ranges.size()) + ", " + std::to_string((double)records / ranges.size()) + " records on average, " +
+                                      std::to_string(fannedOut) + " across shards");
+        printKeyValue("Single tree latency", std::to_string(singleDuration.count() / ranges.size()) + " microseconds");
+        printKeyValue("Sharded latency", std::to_string(shardedDuration.count() / ranges.size()) + " microseconds");
+        printKeyValue("Same records in the same order", sameOrder ? "yes" : "no");
+    };
+    std::vector<std::pair<int, int>> narrow, wide;
+    for (int i = 0; i < 2000; i++)
+    {
+        narrow.push_back(std::make_pair(pointKeys[i], pointKeys[i] + 1000));
+    }
+    std::vector<int> allKeys;
+    for (const std::pair<int, unsigned char *> &entry : entries)
+    {
+        allKeys.push_back(entry.first);
+    }
+    std::sort(allKeys.begin(), allKeys.end());
+    for (int i = 0; i < 20; i++)
+    {
+        wide.push_back(std::make_pair(allKeys[allKeys.size() / 10], allKeys[allKeys.size() * 9 / 10]));
+    }
+    compareRanges("Narrow range searches", narrow);
+    compareRanges("Wide range searches", wide);
+
+    // Concurrent inserts: every thread inserts a slice of the shuffled entries, into one
+    // tree behind one lock or into the shards behind one lock each
+    std::vector<std::pair<int, unsigned char *>> shuffled = entries;
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+    auto runWriters = [&](const std::function<void(const std::pair<int, unsigned char *> &)> &insert) {
+        std::vector<std::thread> writers;
+        auto writerStart = std::chrono::high_resolution_clock::now();
+        for (int t = 0; t < numThreads; t++)
+        {
+            writers.push_back(std::thread([&, t]() {
+                for (size_t i = shuffled.size() * t / numThreads; i < shuffled.size() * (t + 1) / numThreads; i++)
+                {
+                    insert(shuffled[i]);
+                }
+            }));
+        }
+        for (std::thread &writer : writers)
+        {
+            writer.join();
+        }
+        std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - writerStart;
+        return duration.count();
+    };
+    BPlusTree lockedTree;
+    lockedTree.setVerbose(false);
+    std::mutex treeMutex;
+    double lockedMilliseconds = runWriters([&](const std::pair<int, unsigned char *> &entry) {
+        std::lock_guard<std::mutex> lock(treeMutex);
+        lockedTree.insertKey(entry.first, entry.second);
+    });
+    ShardedIndex concurrent(numShards);
+    std::vector<int> sample;
+    for (size_t i = 0; i < sampleSize; i++)
+    {
+        sample.push_back(entries[rng() % entries.size()].first);
+    }
+    concurrent.setBoundaries(sample);
+    double shardedMilliseconds = runWriters([&](const std::pair<int, unsigned char *> &entry) {
+        concurrent.insertKey(entry.first, entry.second);
+    });
+
+    printHeader("Concurrent inserts");
+    printKeyValue("Writer threads", std::to_string(numThreads) + ", " + std::to_string(shuffled.size()) + " inserts in random order");
+    printKeyValue("Single tree, one lock", std::to_string((long)(shuffled.size() / (lockedMilliseconds / 1000.0))) + " inserts/sec");
+    printKeyValue("Sharded, lock per shard", std::to_string((long)(shuffled.size() / (shardedMilliseconds / 1000.0))) + " inserts/sec");
+    printKeyValue("Records in the single tree", std::to_string(lockedTree.rangeSearch(INT_MIN, INT_MAX).size()));
+    printKeyValue("Records in the shards", std::to_string(concurrent.rangeSearch(INT_MIN, INT_MAX).size()));
+    printKeyValue("Hardware threads", std::to_string(std::thread::hardware_concurrency()));
+}
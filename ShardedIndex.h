@@ -0,0 +1,50 @@
+#ifndef SHARDEDINDEX_H
+#define SHARDEDINDEX_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "BPlusTree.h"
+
+// numVotes index split by key range into shards, each its own B+ tree with its own lock.
+//
+// Shard i holds the keys from boundaries[i - 1] up to, but not including, boundaries[i];
+// the first and last shards are open ended. The boundaries are quantiles of a sample of
+// the keys taken at load time, so every shard starts with about the same number of records.
+//
+// Point operations lock and touch one shard only, so writers to different shards never
+// wait for each other. A range search runs on every shard it overlaps, each on its own
+// thread; shards cover increasing key ranges, so appending their results in shard order
+// gives the records in key order.
+class ShardedIndex
+{
+public:
+    explicit ShardedIndex(int numShards);
+    // Boundaries at the quantiles of sampleKeys. Repeated sample values are merged, which can
+    // leave fewer shards than asked for. Returns false, changing nothing, unless the index is empty.
+    bool setBoundaries(std::vector<int> sampleKeys);
+    // Sample sampleSize keys, set the boundaries and build every shard on its own thread;
+    // false if the index is not empty
+    bool load(const std::vector<std::pair<int, unsigned char *>> &entries, size_t sampleSize);
+    void insertKey(int key, unsigned char *recordPtr);
+    void deleteKey(int key);
+    std::vector<unsigned char *> lookup(int key, AccessStats *stats = nullptr) const;
+    std::vector<unsigned char *> rangeSearch(int minKey, int maxKey, AccessStats *stats = nullptr) const;
+    int shardOf(int key) const;
+    int shardCount() const;
+    const std::vector<int> &getBoundaries() const;
+    const BPlusTree &shard(int i) const;
+
+private:
+    int requestedShards;
+    std::vector<int> boundaries; // first key of every shard but the first
+    std::vector<std::unique_ptr<BPlusTree>> shards;
+    mutable std::vector<std::unique_ptr<std::mutex>> locks; // one per shard, held by readers and writers
+
+    void rangeSearchShard(int i, int minKey, int maxKey, std::vector<unsigned char *> &out, AccessStats &stats) const;
+};
+
+// Compare a sharded index with a single B+ tree: build time, point lookups, range fan-out and concurrent inserts
+void experimentShardedIndex(const SimulatedDisk &disk);
+
+#endif // SHARDEDINDEX_H
@@ -0,0 +1,263 @@
+#include "StaticBTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+RecordSpan::RecordSpan(unsigned char *const *first, unsigned char *const *last) : first(first), last(last) {}
+
+unsigned char *const *RecordSpan::begin() const
+{
+    return first;
+}
+
+unsigned char *const *RecordSpan::end() const
+{
+    return last;
+}
+
+size_t RecordSpan::size() const
+{
+    return last - first;
+}
+
+bool RecordSpan::empty() const
+{
+    return first == last;
+}
+
+StaticBTree::StaticBTree(const BPlusTree &tree) : nodeKeys(nullptr), numNodes(0), numKeys(0), levels(0)
+{
+    // A full range search returns every posting list in key order, and the index key of a
+    // record is its numVotes, so the entries need no sorting
+    std::vector<std::pair<int, unsigned char *>> entries;
+    for (unsigned char *record : tree.rangeSearch(INT_MIN, INT_MAX))
+    {
+        entries.push_back(std::make_pair(reinterpret_cast<const Record *>(record)->numVotes, record));
+    }
+
+    std::vector<int> &keys = sortedKeys;
+    records.reserve(entries.size());
+    for (const std::pair<int, unsigned char *> &entry : entries)
+    {
+        if (keys.empty() || keys.back() != entry.first)
+        {
+            keys.push_back(entry.first);
+            offsets.push_back(records.size());
+        }
+        records.push_back(entry.second);
+    }
+    offsets.push_back(records.size());
+
+    numKeys = (int)keys.size();
+    numNodes = (numKeys + KEYS_PER_NODE - 1) / KEYS_PER_NODE;
+    storage.assign((size_t)numNodes * KEYS_PER_NODE + KEYS_PER_NODE, INT_MAX);
+    size_t misalignment = reinterpret_cast<uintptr_t>(storage.data()) % (KEYS_PER_NODE * sizeof(int));
+    nodeKeys = storage.data() + (misalignment == 0 ? 0 : (KEYS_PER_NODE * sizeof(int) - misalignment) / sizeof(int));
+    ranks.assign((size_t)numNodes * KEYS_PER_NODE, numKeys);
+    int next = 0;
+    build(0, next);
+    for (int node = 0; node < numNodes; node = node * (KEYS_PER_NODE + 1) + 1)
+    {
+        levels++;
+    }
+}
+
+// Fills the subtree of node in key order
+void StaticBTree::build(int node, int &next)
+{
+    if (node >= numNodes)
+        return;
+    for (int i = 0; i < KEYS_PER_NODE; i++)
+    {
+        build(node * (KEYS_PER_NODE + 1) + i + 1, next);
+        if (next < numKeys)
+        {
+            nodeKeys[node * KEYS_PER_NODE + i] = sortedKeys[next];
+            ranks[node * KEYS_PER_NODE + i] = next;
+            next++;
+        }
+    }
+    build(node * (KEYS_PER_NODE + 1) + KEYS_PER_NODE + 1, next);
+}
+
+// Rank of the first key >= x, numKeys if there is none. Within a node the number of keys
+// below x is both the position of the candidate and the child to descend into; a candidate
+// found further down is always smaller than the one above it.
+int StaticBTree::lowerBound(int x, AccessStats *stats) const
+{
+    int result = numKeys;
+    int node = 0;
+    while (node < numNodes)
+    {
+        const int *keys = nodeKeys + node * KEYS_PER_NODE;
+        int below = 0;
+#ifdef __SSE2__
+        __m128i needle = _mm_set1_epi32(x);
+        unsigned mask = 0;
+        for (int j = 0; j < KEYS_PER_NODE / 4; j++)
+        {
+            __m128i lanes = _mm_load_si128(reinterpret_cast<const __m128i *>(keys) + j);
+            mask |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(needle, lanes))) << (4 * j);
+        }
+        below = __builtin_popcount(mask);
+#else
+        while (below < KEYS_PER_NODE && keys[below] < x)
+        {
+            below++;
+        }
+#endif
+        if (stats != nullptr)
+            stats->indexNodes++;
+        if (below < KEYS_PER_NODE)
+            result = ranks[node * KEYS_PER_NODE + below];
+        node = node * (KEYS_PER_NODE + 1) + below + 1;
+    }
+    return result;
+}
+
+RecordSpan StaticBTree::lookup(int x, AccessStats *stats) const
+{
+    int rank = lowerBound(x, stats);
+    if (rank == numKeys || sortedKeys[rank] != x)
+        return RecordSpan();
+    if (stats != nullptr)
+        stats->records += (int)(offsets[rank + 1] - offsets[rank]);
+    return RecordSpan(records.data() + offsets[rank], records.data() + offsets[rank + 1]);
+}
+
+std::vector<unsigned char *> StaticBTree::rangeSearch(int minKey, int maxKey, AccessStats *stats) const
+{
+    if (minKey > maxKey)
+        return std::vector<unsigned char *>();
+    int first = lowerBound(minKey, stats);
+    int last = maxKey == INT_MAX ? numKeys : lowerBound(maxKey + 1, stats);
+    if (stats != nullptr)
+        stats->records += (int)(offsets[last] - offsets[first]);
+    return std::vector<unsigned char *>(records.begin() + offsets[first], records.begin() + offsets[last]);
+}
+
+int StaticBTree::height() const
+{
+    return levels;
+}
+
+int StaticBTree::nodeCount() const
+{
+    return numNodes;
+}
+
+int StaticBTree::keyCount() const
+{
+    return numKeys;
+}
+
+size_t StaticBTree::memoryBytes() const
+{
+    return storage.size() * sizeof(int) + ranks.size() * sizeof(int) + sortedKeys.size() * sizeof(int) +
+           offsets.size() * sizeof(size_t) + records.size() * sizeof(unsigned char *);
+}
+
+void experimentStaticBTree(const BPlusTree &tree)
+{
+    if (tree.height() == 0)
+    {
+        std::cout << "The B+ tree is empty, run experiment 2 first" << std::endl;
+        return;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    StaticBTree exported(tree);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> exportDuration = end - start;
+
+    // Probe keys are drawn uniformly from the distinct numVotes values
+    std::vector<int> distinctKeys;
+    for (unsigned char *record : exported.rangeSearch(INT_MIN, INT_MAX))
+    {
+        int key = reinterpret_cast<Record *>(record)->numVotes;
+        if (distinctKeys.empty() || distinctKeys.back() != key)
+            distinctKeys.push_back(key);
+    }
+    std::mt19937 rng(3020);
+    std::vector<int> pointKeys;
+    for (int i = 0; i < 100000; i++)
+    {
+        pointKeys.push_back(distinctKeys[rng() % distinctKeys.size()]);
+    }
+    std::vector<int> rangeStarts(pointKeys.begin(), pointKeys.begin() + 2000);
+    const int rangeWidth = 1000;
+
+    printHeader("Static B-tree export");
+    printKeyValue("Keys per node", std::to_string(StaticBTree::KEYS_PER_NODE) + " (64 bytes)");
+    printKeyValue("Number of nodes", std::to_string(exported.nodeCount()) + " (B+ tree: " + std::to_string(tree.nodeCount()) + ")");
+    printKeyValue("Number of levels", std::to_string(exported.height()) + " (B+ tree: " + std::to_string(tree.height()) + ")");
+    printKeyValue("Number of keys", std::to_string(exported.keyCount()));
+    printKeyValue("Memory", std::to_string(exported.memoryBytes()) + " bytes, records included");
+    printKeyValue("Export time", std::to_string(exportDuration.count()) + " milliseconds");
+
+    // Point lookups: both sides read every record address of the posting list
+    bool sameResults = true;
+    AccessStats mutableStats, staticStats;
+    uintptr_t mutableChecksum = 0, staticChecksum = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int key : pointKeys)
+    {
+        for (PostingIterator it = tree.lookup(key, &mutableStats); it.valid(); ++it)
+        {
+            mutableChecksum += reinterpret_cast<uintptr_t>(*it);
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> mutableDuration = end - start;
+    start = std::chrono::high_resolution_clock::now();
+    for (int key : pointKeys)
+    {
+        for (unsigned char *record : exported.lookup(key, &staticStats))
+        {
+            staticChecksum += reinterpret_cast<uintptr_t>(record);
+        }
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> staticDuration = end - start;
+    sameResults = sameResults && mutableChecksum == staticChecksum;
+
+    printHeader("Point lookups");
+    printKeyValue("Lookups", std::to_string(pointKeys.size()));
+    printKeyValue("B+ tree latency", std::to_string(mutableDuration.count() / pointKeys.size()) + " ns, " +
+                                         std::to_string((double)(mutableStats.indexNodes + mutableStats.leafNodes) / pointKeys.size()) + " nodes per lookup");
+    printKeyValue("Static B-tree latency", std::to_string(staticDuration.count() / pointKeys.size()) + " ns, " +
+                                               std::to_string((double)staticStats.indexNodes / pointKeys.size()) + " nodes per lookup");
+
+    // Range searches of a fixed width from the same starting keys
+    mutableStats = AccessStats();
+    staticStats = AccessStats();
+    size_t mutableRecords = 0, staticRecords = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int minKey : rangeStarts)
+    {
+        mutableRecords += tree.rangeSearch(minKey, minKey + rangeWidth, &mutableStats).size();
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::micro> mutableRangeDuration = end - start;
+    start = std::chrono::high_resolution_clock::now();
+    for (int minKey : rangeStarts)
+    {
+        staticRecords += exported.rangeSearch(minKey, minKey + rangeWidth, &staticStats).size();
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::micro> staticRangeDuration = end - start;
+    sameResults = sameResults && mutableRecords == staticRecords;
+
+    printHeader("Range searches");
+    printKeyValue("Searches", std::to_string(rangeStarts.size()) + " of width " + std::to_string(rangeWidth) + ", " +
+                                  std::to_string((double)staticRecords / rangeStarts.size()) + " records on average");
+    printKeyValue("B+ tree latency", std::to_string(mutableRangeDuration.count() / rangeStarts.size()) + " microseconds, " +
+                                         std::to_string((double)(mutableStats.indexNodes + mutableStats.leafNodes) / rangeStarts.size()) + " nodes per search");
+    printKeyValue("Static B-tree latency", std::to_string(staticRangeDuration.count() / rangeStarts.size()) + " microseconds, " +
+                                               std::to_string((double)staticStats.indexNodes / rangeStarts.size()) + " nodes per search");
+    printKeyValue("Same records as B+ tree", sameResults ? "yes" : "no");
+}
@@ -0,0 +1,63 @@
+#ifndef STATICBTREE_H
+#define STATICBTREE_H
+
+#include <vector>
+#include "BPlusTree.h"
+
+// Records of one key, stored next to each other in the static tree
+class RecordSpan
+{
+    unsigned char *const *first;
+    unsigned char *const *last;
+
+public:
+    RecordSpan(unsigned char *const *first = nullptr, unsigned char *const *last = nullptr);
+    unsigned char *const *begin() const;
+    unsigned char *const *end() const;
+    size_t size() const;
+    bool empty() const;
+};
+
+// Immutable, pointer-free copy of a B+ tree's numVotes index (a static B-tree, or S-tree).
+//
+// The distinct keys are stored in nodes of 16 ints, one 64-byte cache line each,
+// with no child pointers: the children of node k are nodes k * 17 + 1 to k * 17 + 17,
+// and every node is full apart from the padding at the very end. A search reads one
+// cache line per level and finds its child with four SSE2 compares.
+//
+// All records are kept in key order in one array, so a posting list and the result
+// of a range search are both a contiguous slice of it.
+class StaticBTree
+{
+public:
+    static const int KEYS_PER_NODE = 16;
+
+    explicit StaticBTree(const BPlusTree &tree);
+    StaticBTree(const StaticBTree &) = delete; // nodeKeys points into storage
+    StaticBTree &operator=(const StaticBTree &) = delete;
+    RecordSpan lookup(int x, AccessStats *stats = nullptr) const;
+    std::vector<unsigned char *> rangeSearch(int minKey, int maxKey, AccessStats *stats = nullptr) const;
+    int height() const;
+    int nodeCount() const;
+    int keyCount() const;
+    size_t memoryBytes() const;
+
+private:
+    std::vector<int> storage; // node keys, over-allocated so that they can start on a cache line
+    int *nodeKeys;            // KEYS_PER_NODE keys per node, INT_MAX as padding
+    std::vector<int> ranks;   // position in sorted key order of every node slot, numKeys for padding
+    std::vector<int> sortedKeys;
+    std::vector<size_t> offsets; // first record of every key, plus the total at the end
+    std::vector<unsigned char *> records;
+    int numNodes;
+    int numKeys;
+    int levels;
+
+    void build(int node, int &next);
+    int lowerBound(int x, AccessStats *stats) const;
+};
+
+// Export the B+ tree built in experiment 2 to a static B-tree and compare point and range lookups
+void experimentStaticBTree(const BPlusTree &tree);
+
+#endif // STATICBTREE_H
@@ -9,7 +9,11 @@
 #include <sstream>
 #include <algorithm>
 #include <iomanip>
+#include <functional>
+#include <unordered_map>
+#include <set>
 #include "Record.h"
+#include "ZoneMap.h"
 #include "BPlusTree.h"
 
 // Constants
@@ -28,6 +32,21 @@ void printHeader(const std::string &title);
 // Print a key-value pair
 void printKeyValue(const std::string &key, const std::string &value);
 
+// Location of a record on the simulated disk
+struct RecordLocation
+{
+    uint32_t blockId;
+    uint32_t slot;
+};
+
+// Columns the data file can be clustered on
+enum SortColumn
+{
+    SORT_BY_NUM_VOTES,
+    SORT_BY_AVERAGE_RATING,
+    SORT_BY_TCONST
+};
+
 // Block class
 class Block
 {
@@ -36,7 +55,10 @@ public:
     void writeToDisk(std::ofstream &out) const;
     bool canAddRecord() const;
     void addRecord(const Record &record);
-    size_t size() const;
+    size_t size() const;      // slots in use, deleted ones included
+    size_t liveCount() const; // slots holding a record that was not deleted
+    bool deleteRecord(size_t slot);
+    long freeSlot() const; // first deleted slot, -1 if there is none
 };
 
 class BPlusTree; // forward declare
@@ -45,20 +67,61 @@ class SimulatedDisk
 {
 private:
     std::vector<Block> blocks;
+    std::vector<BlockSummary> summaries; // zone map and Bloom filters of each block
     size_t capacity;
+    bool bloomFilters;
+    mutable std::vector<std::pair<const Record *, size_t>> addressIndex; // first record of each block, sorted by address
+    std::vector<unsigned char> freeSlots;                                // free-space map: deleted slots in each block
+    std::set<size_t> blocksWithFreeSlots;                                // blocks new records go to before the last one
+
+    BlockSummary summarize(const Block &block) const;
+    void addToSummary(BlockSummary &summary, const Record &record) const;
+    void rebuildFreeSpaceMap();
 
 public:
-    SimulatedDisk(size_t diskCapacity = DISK_CAPACITY);
+    SimulatedDisk(size_t diskCapacity = DISK_CAPACITY, bool buildBloomFilters = false);
     bool canAddBlock() const;
     void addBlock(const Block &block);
+    Record *insertRecord(const Record &record);
     void writeToDisk(const std::string &filename);
     size_t totalBlocks() const;
     size_t totalRecords() const;
     size_t usedCapacity() const;
+    size_t liveBytes() const;
+    size_t deadBytes() const;
+    size_t blocksWithHoles() const;
+    std::vector<Block> &getBlocks();
+    const std::vector<Block> &getBlocks() const;
+    Record *getRecord(const RecordLocation &location);
+    const BlockSummary &getSummary(size_t blockId) const;
+    void rebuildSummaries();
+    void scan(const ScanPredicate &predicate, const std::function<void(const Record &)> &visit, ScanStats &stats) const;
+    long blockIdOf(const unsigned char *recordPtr) const;
+    bool deleteRecord(const unsigned char *recordPtr);
+    size_t compact(double maxLiveFraction, std::unordered_map<unsigned char *, unsigned char *> &relocated);
+    void reorganize(SortColumn column, std::unordered_map<unsigned char *, unsigned char *> &relocated);
+    // Records that were not deleted, in disk order; every index build starts from these
+    std::vector<Record *> liveRecords() const;
+    std::vector<Record *> sortedLiveRecords(SortColumn column) const; // stable, ties keep disk order
+    // (numVotes, record) pairs of the live records, in numVotes order unless sorted is false
+    std::vector<std::pair<int, unsigned char *>> numVotesEntries(bool sorted = true) const;
     void loadBPlusTree(BPlusTree &tree);
 };
 
+// Split one line of a TSV file into its fields
+void splitTSVLine(const std::string &line, std::vector<std::string> &fields);
+
+// Record from the tconst, averageRating and numVotes fields of a ratings TSV line
+Record recordFromTSVFields(const std::vector<std::string> &fields, const std::string &line);
+
+// Call onRow with the tab-separated fields of every line after the header, return the number of lines read
+size_t readTSVRows(const std::string &filename, const std::function<void(const std::vector<std::string> &fields, const std::string &line)> &onRow);
+
 // Function to read TSV and create blocks
 void readTSVAndCreateBlocks(const std::string &filename, SimulatedDisk &disk);
 
+// Delete the records of the smallest numVotes values from the disk and the index, refill
+// the free slots with new records, then compact the sparse blocks and remap the index
+void experimentCompaction(SimulatedDisk &disk, BPlusTree &tree);
+
 #endif // STORAGE_H
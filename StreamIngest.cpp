@@ -0,0 +1,216 @@
+#include "StreamIngest.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+TSVTailReader::TSVTailReader(const std::string &filename, const std::string &stateFilename)
+    : filename(filename), stateFilename(stateFilename), offset(0), rows(0)
+{
+    if (!stateFilename.empty())
+    {
+        std::ifstream state(stateFilename);
+        state >> offset >> rows;
+        if (!state)
+        {
+            offset = 0;
+            rows = 0;
+        }
+    }
+}
+
+void TSVTailReader::saveState() const
+{
+    // Written to a temporary file first so that a crash never leaves a half-written offset
+    std::string tmpFilename = stateFilename + ".tmp";
+    {
+        std::ofstream state(tmpFilename, std::ios::trunc);
+        state << offset << " " << rows << std::endl;
+    }
+    std::rename(tmpFilename.c_str(), stateFilename.c_str());
+}
+
+size_t TSVTailReader::poll(const std::function<bool(const std::vector<std::string> &, const std::string &)> &onRow, size_t maxRows)
+{
+    std::ifstream tsvFile(filename, std::ios::binary);
+    if (!tsvFile.is_open())
+        return 0;
+
+    tsvFile.seekg(0, std::ios::end);
+    uint64_t fileSize = (uint64_t)tsvFile.tellg();
+    if (fileSize < offset)
+    {
+        std::cerr << filename << " is shorter than the last offset read, reading it again from the start" << std::endl;
+        offset = 0;
+    }
+    tsvFile.seekg(offset);
+
+    std::string line;
+    std::vector<std::string> fields;
+    size_t count = 0;
+    while ((maxRows == 0 || count < maxRows) && std::getline(tsvFile, line))
+    {
+        if (tsvFile.eof())
+            break; // no newline yet, the writer is still in the middle of this line
+        uint64_t lineStart = offset;
+        offset += line.size() + 1;
+        if (lineStart == 0 || line.empty())
+            continue; // header
+        splitTSVLine(line, fields);
+        if (!onRow(fields, line))
+        {
+            offset = lineStart;
+            break;
+        }
+        count++;
+    }
+    rows += count;
+    if (!stateFilename.empty())
+        saveState();
+    return count;
+}
+
+uint64_t TSVTailReader::position() const
+{
+    return offset;
+}
+
+uint64_t TSVTailReader::rowsRead() const
+{
+    return rows;
+}
+
+IngestBatch ingestAppendedRows(TSVTailReader &reader, SimulatedDisk &disk, BPlusTree &tree, size_t maxRows)
+{
+    IngestBatch batch = {0, 0, 0.0};
+    size_t blocksBefore = disk.totalBlocks();
+    bool wasVerbose = tree.isVerbose();
+    tree.setVerbose(false);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    reader.poll([&](const std::vector<std::string> &fields, const std::string &line) {
+        Record *stored = disk.insertRecord(recordFromTSVFields(fields, line));
+        if (stored == nullptr)
+            return false;
+        tree.insertKey(stored->numVotes, reinterpret_cast<unsigned char *>(stored));
+        batch.rows++;
+        return true;
+    }, maxRows);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    tree.setVerbose(wasVerbose);
+    std::chrono::duration<double, std::milli> duration = end - start;
+    batch.milliseconds = duration.count();
+    batch.newBlocks = disk.totalBlocks() - blocksBefore;
+    return batch;
+}
+
+void experimentStreamingIngest(const SimulatedDisk &sharedDisk)
+{
+    if (sharedDisk.totalRecords() == 0)
+    {
+        std::cout << "The disk is empty, run experiment 1 first" << std::endl;
+        return;
+    }
+
+    // The rows go into a copy of the disk and an index built over it, so the experiments
+    // run afterwards still see only the loaded data
+    auto copyStart = std::chrono::high_resolution_clock::now();
+    SimulatedDisk disk;
+    for (const Block &block : sharedDisk.getBlocks())
+    {
+        disk.addBlock(block);
+    }
+    BPlusTree tree;
+    tree.setVerbose(false);
+    disk.loadBPlusTree(tree);
+    std::chrono::duration<double, std::milli> copyDuration = std::chrono::high_resolution_clock::now() - copyStart;
+
+    const std::string feedFilename = "stream_feed.tsv";
+    {
+        std::ofstream feed(feedFilename, std::ios::trunc);
+        feed << "tconst\taverageRating\tnumVotes\n";
+    }
+    TSVTailReader reader(feedFilename);
+
+    // New rows copy the rating and votes of random existing records under new tconst values
+    std::vector<const Record *> existing;
+    for (const Block &block : disk.getBlocks())
+    {
+        for (const Record &record : block.records)
+        {
+            if (!record.isDeleted())
+                existing.push_back(&record);
+        }
+    }
+    std::mt19937 rng(3020);
+    std::vector<std::pair<int, std::string>> written;
+    std::string unfinished; // rest of the line the previous batch stopped in the middle of
+    const size_t batchSizes[5] = {10, 100, 1000, 5000, 20000};
+    size_t lastBlockRecords = disk.getBlocks().back().size();
+    int keysBefore = tree.keyCount();
+
+    printHeader("Streaming Ingest");
+    printKeyValue("Working copy", std::to_string(disk.totalBlocks()) + " blocks and their index, built in " + std::to_string(copyDuration.count()) + " milliseconds");
+    printKeyValue("Last block before ingest", std::to_string(lastBlockRecords) + " of " + std::to_string(BLOCK_SIZE / sizeof(Record)) + " records");
+    size_t totalRows = 0, totalBlocks = 0;
+    double totalMilliseconds = 0.0;
+    for (size_t b = 0; b < 5; b++)
+    {
+        {
+            std::ofstream feed(feedFilename, std::ios::app);
+            feed << unfinished;
+            unfinished.clear();
+            for (size_t i = 0; i < batchSizes[b]; i++)
+            {
+                const Record *source = existing[rng() % existing.size()];
+                char tconst[16];
+                std::snprintf(tconst, sizeof(tconst), "ts%07zu", written.size() % 10000000);
+                std::ostringstream line;
+                line << tconst << "\t" << std::fixed << std::setprecision(1) << source->averageRating << "\t" << source->numVotes << "\n";
+                written.push_back(std::make_pair(source->numVotes, std::string(tconst)));
+                // Every batch but the last ends halfway through a line, as a writer caught mid-append would
+                std::string text = line.str();
+                if (i + 1 == batchSizes[b] && b + 1 < 5)
+                {
+                    feed << text.substr(0, text.size() / 2);
+                    unfinished = text.substr(text.size() / 2);
+                }
+                else
+                {
+                    feed << text;
+                }
+            }
+        }
+
+        IngestBatch batch = ingestAppendedRows(reader, disk, tree);
+        totalRows += batch.rows;
+        totalBlocks += batch.newBlocks;
+        totalMilliseconds += batch.milliseconds;
+        double rowsPerSecond = batch.milliseconds > 0 ? batch.rows / (batch.milliseconds / 1000.0) : 0.0;
+        printKeyValue("Batch " + std::to_string(b + 1),
+                      std::to_string(batch.rows) + " rows, " + std::to_string(batch.milliseconds) + " milliseconds, " +
+                          std::to_string((long)rowsPerSecond) + " rows/sec, " + std::to_string(batch.newBlocks) + " new blocks");
+    }
+
+    // Every row written must be reachable through the index
+    size_t found = 0;
+    for (const std::pair<int, std::string> &row : written)
+    {
+        for (PostingIterator it = tree.lookup(row.first); it.valid(); ++it)
+        {
+            if (row.second == reinterpret_cast<const Record *>(*it)->tconst)
+            {
+                found++;
+                break;
+            }
+        }
+    }
+
+    printKeyValue("Rows ingested", std::to_string(totalRows) + " of " + std::to_string(written.size()) + " written");
+    printKeyValue("Blocks added", std::to_string(totalBlocks));
+    printKeyValue("Total ingest time", std::to_string(totalMilliseconds) + " milliseconds");
+    printKeyValue("Byte offset reached", std::to_string(reader.position()));
+    printKeyValue("New keys in the index", std::to_string(tree.keyCount() - keysBefore));
+    printKeyValue("Rows found through the index", std::to_string(found));
+    std::remove(feedFilename.c_str());
+}
@@ -0,0 +1,50 @@
+#ifndef STREAMINGEST_H
+#define STREAMINGEST_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include "Storage.h"
+#include "BPlusTree.h"
+
+// Follows a TSV file that the feed keeps appending to. Every poll starts at the
+// byte offset where the previous one stopped and reads only the complete lines
+// written since; a last line still missing its newline is left for the next poll.
+// With a state file the offset survives restarts: it is loaded on construction
+// and saved after every poll.
+class TSVTailReader
+{
+    std::string filename;
+    std::string stateFilename;
+    uint64_t offset; // first byte not processed yet
+    uint64_t rows;
+
+    void saveState() const;
+
+public:
+    TSVTailReader(const std::string &filename, const std::string &stateFilename = "");
+    // onRow returns false to stop; that row is read again by the next poll
+    size_t poll(const std::function<bool(const std::vector<std::string> &fields, const std::string &line)> &onRow, size_t maxRows = 0);
+    uint64_t position() const;
+    uint64_t rowsRead() const;
+};
+
+// Outcome of one ingest call
+struct IngestBatch
+{
+    size_t rows;      // rows stored and indexed
+    size_t newBlocks; // blocks added to the disk; the rest went into the partially filled last block
+    double milliseconds;
+};
+
+// Appends the rows written since the last poll to the disk, one record at a time
+// through insertRecord, and inserts only those records into the existing index.
+// Stops early when the disk is full, leaving the remaining rows in the file.
+IngestBatch ingestAppendedRows(TSVTailReader &reader, SimulatedDisk &disk, BPlusTree &tree, size_t maxRows = 0);
+
+// Feed batches of growing size into a TSV file and ingest each one as it lands, reporting latency and rows/sec per batch.
+// The rows go into a copy of the disk and a fresh index over it; the disk passed in is left as it is.
+void experimentStreamingIngest(const SimulatedDisk &disk);
+
+#endif // STREAMINGEST_H
@@ -0,0 +1,60 @@
+#include "Title.h"
+
+const size_t TitleTable::RECORDS_PER_BLOCK = BLOCK_SIZE / sizeof(TitleRecord);
+
+// \N marks a missing value in the IMDb dumps
+static short convertOptionalShort(const std::string &str, const std::string &fullLine)
+{
+    if (str.empty() || str == "\\N")
+        return 0;
+    return (short)convertToInt(str, fullLine);
+}
+
+// Columns: tconst, titleType, primaryTitle, originalTitle, isAdult, startYear, endYear, runtimeMinutes, genres
+size_t TitleTable::load(const std::string &filename, size_t maxRows)
+{
+    blocks.clear();
+    std::vector<TitleRecord> currentBlock;
+    size_t rows = 0;
+
+    readTSVRows(filename, [&](const std::vector<std::string> &fields, const std::string &line) {
+        if (fields.size() < 8 || (maxRows > 0 && rows >= maxRows))
+            return;
+        TitleRecord title(fields[0], fields[1], fields[2],
+                          convertOptionalShort(fields[5], line), convertOptionalShort(fields[7], line));
+
+        if (currentBlock.size() == RECORDS_PER_BLOCK)
+        {
+            blocks.push_back(currentBlock);
+            currentBlock.clear();
+        }
+        currentBlock.push_back(title);
+        rows++;
+    });
+
+    if (!currentBlock.empty())
+    {
+        blocks.push_back(currentBlock);
+    }
+    return rows;
+}
+
+size_t TitleTable::totalBlocks() const
+{
+    return blocks.size();
+}
+
+size_t TitleTable::totalRecords() const
+{
+    size_t total = 0;
+    for (const std::vector<TitleRecord> &block : blocks)
+    {
+        total += block.size();
+    }
+    return total;
+}
+
+const std::vector<std::vector<TitleRecord>> &TitleTable::getBlocks() const
+{
+    return blocks;
+}
@@ -0,0 +1,45 @@
+#ifndef TITLE_H
+#define TITLE_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include "Storage.h"
+
+// Fixed-size row of title.basics.tsv, cut down to the columns the joins report
+struct TitleRecord {
+    char tconst[10];       // same key format as Record::tconst
+    char titleType[14];    // movie, short, tvSeries, tvMiniSeries, ...
+    char primaryTitle[64]; // truncated to 63 chars
+    short startYear;       // 0 when unknown (\N)
+    short runtimeMinutes;  // 0 when unknown (\N)
+
+    TitleRecord() = default;
+
+    TitleRecord(const std::string &id, const std::string &type, const std::string &title, short year, short runtime) {
+        std::strncpy(tconst, id.c_str(), sizeof(tconst) - 1);
+        tconst[sizeof(tconst) - 1] = '\0';
+        std::strncpy(titleType, type.c_str(), sizeof(titleType) - 1);
+        titleType[sizeof(titleType) - 1] = '\0';
+        std::strncpy(primaryTitle, title.c_str(), sizeof(primaryTitle) - 1);
+        primaryTitle[sizeof(primaryTitle) - 1] = '\0';
+        startYear = year;
+        runtimeMinutes = runtime;
+    }
+};
+
+// Title metadata stored like the ratings: BLOCK_SIZE blocks of fixed-size rows
+class TitleTable
+{
+    std::vector<std::vector<TitleRecord>> blocks;
+
+public:
+    static const size_t RECORDS_PER_BLOCK;
+
+    size_t load(const std::string &filename, size_t maxRows = 0);
+    size_t totalBlocks() const;
+    size_t totalRecords() const;
+    const std::vector<std::vector<TitleRecord>> &getBlocks() const;
+};
+
+#endif // TITLE_H
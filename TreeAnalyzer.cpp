@@ -0,0 +1,365 @@
+#include "TreeAnalyzer.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+LevelFill::LevelFill() : nodes(0), keys(0), underfull(0)
+{
+    std::fill(fillDeciles, fillDeciles + 10, 0);
+}
+
+TreeReport::TreeReport()
+    : violationCount(0), internalNodes(0), leafNodes(0), bufferNodes(0), records(0), keys(0), longestPosting(0),
+      minLeafDepth(-1), maxLeafDepth(-1), threads(1), milliseconds(0.0) {}
+
+bool TreeReport::valid() const
+{
+    return violationCount == 0;
+}
+
+TreeAnalyzer::TreeAnalyzer(const BPlusTree &tree, bool checkRecords) : tree(tree), checkRecords(checkRecords) {}
+
+size_t TreeAnalyzer::nodeBytes()
+{
+    return sizeof(Node) + N * sizeof(int) + (N + 1) * sizeof(Node *) + N * sizeof(unsigned char *);
+}
+
+void TreeAnalyzer::addViolation(TreeReport &report, const std::string &message)
+{
+    if (report.violations.size() < MAX_VIOLATIONS)
+        report.violations.push_back(message);
+    report.violationCount++;
+}
+
+TreeAnalyzer::Bounds TreeAnalyzer::childBounds(const Node *node, int child, const Bounds &bounds)
+{
+    Bounds result = bounds;
+    if (child > 0)
+    {
+        result.hasLow = true;
+        result.low = node->key[child - 1];
+    }
+    if (child < node->size)
+    {
+        result.hasHigh = true;
+        result.high = node->key[child];
+    }
+    return result;
+}
+
+// Checks that only need the node itself and its posting lists, and adds it to the level statistics
+void TreeAnalyzer::checkNode(const Node *node, int depth, const Bounds &bounds, TreeReport &report, std::vector<const Node *> &leaves) const
+{
+    std::string where = "level " + std::to_string(depth) + (node->size > 0 ? ", node from key " + std::to_string(node->key[0]) : ", empty node");
+    bool isRoot = node == tree.root;
+    if (node->size < (isRoot ? 0 : 1) || node->size > N)
+    {
+        addViolation(report, where + ": holds " + std::to_string(node->size) + " keys");
+        return; // the key and pointer arrays cannot be trusted past this
+    }
+    for (int i = 0; i < node->size; i++)
+    {
+        if (i > 0 && node->key[i] <= node->key[i - 1])
+            addViolation(report, where + ": key " + std::to_string(node->key[i]) + " does not follow " + std::to_string(node->key[i - 1]));
+        if ((bounds.hasLow && node->key[i] < bounds.low) || (bounds.hasHigh && node->key[i] >= bounds.high))
+            addViolation(report, where + ": key " + std::to_string(node->key[i]) + " outside the range of its subtree");
+    }
+
+    if ((int)report.levels.size() <= depth)
+        report.levels.resize(depth + 1);
+    LevelFill &level = report.levels[depth];
+    level.nodes++;
+    level.keys += node->size;
+    level.fillDeciles[std::min(9, node->size * 10 / N)]++;
+    int minimum = node->IS_LEAF ? (N + 1) / 2 : N / 2;
+    if (!isRoot && node->size < minimum)
+        level.underfull++;
+
+    if (!node->IS_LEAF)
+    {
+        report.internalNodes++;
+        for (int i = 0; i <= node->size; i++)
+        {
+            if (node->ptr[i] == nullptr)
+                addViolation(report, where + ": child " + std::to_string(i) + " is missing");
+        }
+        return;
+    }
+
+    report.leafNodes++;
+    report.keys += node->size;
+    leaves.push_back(node);
+    report.minLeafDepth = report.minLeafDepth < 0 ? depth : std::min(report.minLeafDepth, depth);
+    report.maxLeafDepth = std::max(report.maxLeafDepth, depth);
+    for (int i = 0; i < node->size; i++)
+    {
+        size_t length = 0;
+        for (const Node *buffer = node->ptr[i]; buffer != nullptr; buffer = buffer->ptr[0])
+        {
+            report.bufferNodes++;
+            if (buffer->size < 1 || buffer->size > N)
+            {
+                addViolation(report, where + ": a buffer node of key " + std::to_string(node->key[i]) + " holds " + std::to_string(buffer->size) + " records");
+                break;
+            }
+            for (int r = 0; checkRecords && r < buffer->size; r++)
+            {
+                const Record *record = reinterpret_cast<const Record *>(buffer->records[r]);
+                if (record == nullptr || record->isDeleted() || record->numVotes != node->key[i])
+                    addViolation(report, where + ": a record of key " + std::to_string(node->key[i]) + " is deleted or has another numVotes");
+            }
+            length += buffer->size;
+        }
+        if (length == 0)
+            addViolation(report, where + ": key " + std::to_string(node->key[i]) + " has no records");
+        report.records += length;
+        report.longestPosting = std::max(report.longestPosting, length);
+        size_t bucket = 0;
+        while (length > 1)
+        {
+            length >>= 1;
+            bucket++;
+        }
+        if (report.postingLengths.size() <= bucket)
+            report.postingLengths.resize(bucket + 1);
+        report.postingLengths[bucket]++;
+    }
+}
+
+void TreeAnalyzer::walk(const Node *node, int depth, const Bounds &bounds, TreeReport &report, std::vector<const Node *> &leaves) const
+{
+    size_t violationsBefore = report.violationCount;
+    checkNode(node, depth, bounds, report, leaves);
+    if (node->IS_LEAF || node->size < 0 || node->size > N || report.violationCount > violationsBefore + (size_t)N)
+        return;
+    for (int i = 0; i <= node->size; i++)
+    {
+        if (node->ptr[i] != nullptr)
+            walk(node->ptr[i], depth + 1, childBounds(node, i, bounds), report, leaves);
+    }
+}
+
+void TreeAnalyzer::merge(TreeReport &into, const TreeReport &from)
+{
+    for (const std::string &violation : from.violations)
+    {
+        if (into.violations.size() < MAX_VIOLATIONS)
+            into.violations.push_back(violation);
+    }
+    into.violationCount += from.violationCount;
+    if (into.levels.size() < from.levels.size())
+        into.levels.resize(from.levels.size());
+    for (size_t d = 0; d < from.levels.size(); d++)
+    {
+        into.levels[d].nodes += from.levels[d].nodes;
+        into.levels[d].keys += from.levels[d].keys;
+        into.levels[d].underfull += from.levels[d].underfull;
+        for (int b = 0; b < 10; b++)
+        {
+            into.levels[d].fillDeciles[b] += from.levels[d].fillDeciles[b];
+        }
+    }
+    if (into.postingLengths.size() < from.postingLengths.size())
+        into.postingLengths.resize(from.postingLengths.size());
+    for (size_t b = 0; b < from.postingLengths.size(); b++)
+    {
+        into.postingLengths[b] += from.postingLengths[b];
+    }
+    into.internalNodes += from.internalNodes;
+    into.leafNodes += from.leafNodes;
+    into.bufferNodes += from.bufferNodes;
+    into.records += from.records;
+    into.keys += from.keys;
+    into.longestPosting = std::max(into.longestPosting, from.longestPosting);
+    if (from.minLeafDepth >= 0)
+        into.minLeafDepth = into.minLeafDepth < 0 ? from.minLeafDepth : std::min(into.minLeafDepth, from.minLeafDepth);
+    into.maxLeafDepth = std::max(into.maxLeafDepth, from.maxLeafDepth);
+}
+
+TreeReport TreeAnalyzer::analyze(int numThreads) const
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    TreeReport report;
+    const Node *root = tree.root;
+    if (root == nullptr)
+        return report;
+    if (numThreads <= 0)
+        numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+    Bounds unbounded = {false, false, 0, 0};
+    std::vector<const Node *> leaves;
+    if (root->IS_LEAF || numThreads == 1 || tree.nodeCount() < PARALLEL_MIN_NODES)
+    {
+        walk(root, 0, unbounded, report, leaves);
+    }
+    else
+    {
+        // The root is checked here; its subtrees are split into contiguous runs, one per thread,
+        // so that the leaves of the threads joined in order are the leaves in key order
+        size_t violationsBefore = report.violationCount;
+        checkNode(root, 0, unbounded, report, leaves);
+        int children = root->size + 1;
+        if (report.violationCount == violationsBefore)
+        {
+            int threads = std::min(numThreads, children);
+            std::vector<TreeReport> partial(threads);
+            std::vector<std::vector<const Node *>> partialLeaves(threads);
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; t++)
+            {
+                workers.push_back(std::thread([&, t]() {
+                    for (int i = children * t / threads; i < children * (t + 1) / threads; i++)
+                    {
+                        walk(root->ptr[i], 1, childBounds(root, i, unbounded), partial[t], partialLeaves[t]);
+                    }
+                }));
+            }
+            for (std::thread &worker : workers)
+            {
+                worker.join();
+            }
+            for (int t = 0; t < threads; t++)
+            {
+                merge(report, partial[t]);
+                leaves.insert(leaves.end(), partialLeaves[t].begin(), partialLeaves[t].end());
+            }
+            report.threads = threads;
+        }
+    }
+
+    if (report.minLeafDepth != report.maxLeafDepth)
+        addViolation(report, "leaves at depths " + std::to_string(report.minLeafDepth) + " to " + std::to_string(report.maxLeafDepth));
+
+    // The leaf chain must visit the same leaves as the walk, in the same order, both ways
+    for (size_t i = 0; i < leaves.size(); i++)
+    {
+        const Node *expectedNext = i + 1 < leaves.size() ? leaves[i + 1] : nullptr;
+        const Node *expectedPrev = i > 0 ? leaves[i - 1] : nullptr;
+        std::string where = "leaf " + std::to_string(i) + (leaves[i]->size > 0 ? " (key " + std::to_string(leaves[i]->key[0]) + ")" : "");
+        if (leaves[i]->ptr[N] != expectedNext)
+            addViolation(report, where + ": next link does not point at the following leaf");
+        if (leaves[i]->prev != expectedPrev)
+            addViolation(report, where + ": prev link does not point at the preceding leaf");
+        if (expectedNext != nullptr && leaves[i]->size > 0 && expectedNext->size > 0 &&
+            leaves[i]->key[leaves[i]->size - 1] >= expectedNext->key[0])
+            addViolation(report, where + ": last key not below the first key of the next leaf");
+    }
+
+    // The counts the tree keeps for its statistics
+    if (tree.keyCount() != report.keys)
+        addViolation(report, "keyCount() is " + std::to_string(tree.keyCount()) + ", the leaves hold " + std::to_string(report.keys));
+    if ((size_t)tree.nodeCount() != report.internalNodes + report.leafNodes)
+        addViolation(report, "nodeCount() is " + std::to_string(tree.nodeCount()) + ", the walk found " + std::to_string(report.internalNodes + report.leafNodes));
+    if ((size_t)tree.height() != report.levels.size())
+        addViolation(report, "height() is " + std::to_string(tree.height()) + ", the walk found " + std::to_string(report.levels.size()) + " levels");
+
+    std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+    report.milliseconds = duration.count();
+    return report;
+}
+
+void TreeAnalyzer::printSummary(const TreeReport &report) const
+{
+    printHeader("Tree Analysis");
+    printKeyValue("Levels", std::to_string(report.levels.size()));
+    printKeyValue("Keys", std::to_string(report.keys));
+    printKeyValue("Records", std::to_string(report.records));
+    printKeyValue("Walk time", std::to_string(report.milliseconds) + " milliseconds, " + std::to_string(report.threads) + " thread(s)");
+
+    printHeader("Fill per level");
+    for (size_t d = 0; d < report.levels.size(); d++)
+    {
+        const LevelFill &level = report.levels[d];
+        std::string deciles;
+        for (int b = 0; b < 10; b++)
+        {
+            deciles += (b > 0 ? " " : "") + std::to_string(level.fillDeciles[b]);
+        }
+        double fill = level.nodes > 0 ? 100.0 * level.keys / ((double)level.nodes * N) : 0.0;
+        printKeyValue("Level " + std::to_string(d), std::to_string(level.nodes) + " nodes, " + std::to_string(fill) + "% full, " +
+                                                       std::to_string(level.underfull) + " underfull, by decile: " + deciles);
+    }
+
+    printHeader("Posting list lengths");
+    for (size_t b = 0; b < report.postingLengths.size(); b++)
+    {
+        size_t low = (size_t)1 << b;
+        std::string label = b == 0 ? std::string("1 record") : std::to_string(low) + " to " + std::to_string(2 * low - 1) + " records";
+        printKeyValue(label, std::to_string(report.postingLengths[b]) + " keys");
+    }
+    printKeyValue("Longest", std::to_string(report.longestPosting) + " records");
+
+    printHeader("Memory per node type");
+    size_t bytes = nodeBytes();
+    printKeyValue("Bytes per node", std::to_string(bytes) + " (" + std::to_string(N) + " keys, arrays included)");
+    printKeyValue("Internal nodes", std::to_string(report.internalNodes) + " nodes, " + std::to_string(report.internalNodes * bytes) + " bytes");
+    printKeyValue("Leaf nodes", std::to_string(report.leafNodes) + " nodes, " + std::to_string(report.leafNodes * bytes) + " bytes");
+    printKeyValue("Buffer nodes", std::to_string(report.bufferNodes) + " nodes, " + std::to_string(report.bufferNodes * bytes) + " bytes, " +
+                                      std::to_string(report.bufferNodes > 0 ? 100.0 * report.records / ((double)report.bufferNodes * N) : 0.0) +
+                                      "% of record slots used");
+
+    printHeader("Invariants");
+    printKeyValue("Result", report.valid() ? "all hold" : std::to_string(report.violationCount) + " violation(s)");
+    for (const std::string &violation : report.violations)
+    {
+        std::cout << "  " << violation << "\n";
+    }
+}
+
+void TreeAnalyzer::dumpLevelOrder(std::ostream &out) const
+{
+    out << "B+ Tree Level-Order Structure:\n";
+    std::vector<const Node *> level, next;
+    if (tree.root != nullptr)
+        level.push_back(tree.root);
+    while (!level.empty())
+    {
+        next.clear();
+        for (size_t n = 0; n < level.size(); n++)
+        {
+            const Node *node = level[n];
+            if (n > 0)
+                out << " | ";
+            for (int i = 0; i < node->size; i++)
+            {
+                out << (i > 0 ? " " : "") << node->key[i];
+            }
+            for (int i = 0; !node->IS_LEAF && i <= node->size; i++)
+            {
+                if (node->ptr[i] != nullptr)
+                    next.push_back(node->ptr[i]);
+            }
+        }
+        out << "\n";
+        level.swap(next);
+    }
+}
+
+void experimentTreeAnalysis(const BPlusTree &tree)
+{
+    if (tree.height() == 0)
+    {
+        std::cout << "The B+ tree is empty, run experiment 2 first" << std::endl;
+        return;
+    }
+
+    TreeAnalyzer analyzer(tree);
+    TreeReport report = analyzer.analyze();
+    analyzer.printSummary(report);
+    TreeReport sequential = analyzer.analyze(1);
+
+    const std::string dumpFilename = "BPlusTreeAnalysis.txt";
+    auto start = std::chrono::high_resolution_clock::now();
+    {
+        std::ofstream out(dumpFilename, std::ios::trunc);
+        analyzer.dumpLevelOrder(out);
+    }
+    std::chrono::duration<double, std::milli> dumpDuration = std::chrono::high_resolution_clock::now() - start;
+
+    printHeader("Level-order dump");
+    printKeyValue("Written to", dumpFilename);
+    printKeyValue("Dump time", std::to_string(dumpDuration.count()) + " milliseconds");
+    printKeyValue("Single-threaded walk", std::to_string(sequential.milliseconds) + " milliseconds, same result: " +
+                                              (sequential.violationCount == report.violationCount && sequential.records == report.records ? "yes" : "no"));
+}
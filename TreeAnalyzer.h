@@ -0,0 +1,85 @@
+#ifndef TREEANALYZER_H
+#define TREEANALYZER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "BPlusTree.h"
+
+// Node fill of one level of the tree
+struct LevelFill
+{
+    int nodes;
+    long keys;
+    int underfull;       // non-root nodes below the minimum a delete leaves behind, expected after append splits
+    int fillDeciles[10]; // nodes by keys / N: 0-10%, 10-20%, ..., 90-100%
+
+    LevelFill();
+};
+
+// Outcome of one walk over a B+ tree
+struct TreeReport
+{
+    size_t violationCount;
+    std::vector<std::string> violations; // the first MAX_VIOLATIONS of them
+    std::vector<LevelFill> levels;       // root level first
+    std::vector<size_t> postingLengths;  // bucket b counts posting lists of 2^b to 2^(b+1) - 1 records
+    size_t internalNodes;
+    size_t leafNodes;
+    size_t bufferNodes;
+    size_t records;
+    long keys;
+    size_t longestPosting;
+    int minLeafDepth; // -1 until a leaf is found
+    int maxLeafDepth;
+    int threads;
+    double milliseconds;
+
+    TreeReport();
+    bool valid() const;
+};
+
+// Walks a BPlusTree once, checking its invariants and collecting its shape:
+//  - keys strictly increase within a node and stay inside the range the parent gives the subtree
+//  - every node holds 1 to N keys (the root may be empty), every internal node has size + 1 children
+//    and every leaf is at the same depth
+//  - the next and prev links chain the leaves in key order, both ways
+//  - every posting list is a non-empty chain of buffer nodes; with checkRecords, every record
+//    it points at is live and has the key's numVotes
+//  - the node, key and level counts the tree keeps match what the walk found
+//
+// Big trees are walked in parallel, the subtrees under the root split across the threads.
+class TreeAnalyzer
+{
+public:
+    static const size_t MAX_VIOLATIONS = 20;
+    static const int PARALLEL_MIN_NODES = 2000; // smaller trees are walked on the calling thread
+
+    explicit TreeAnalyzer(const BPlusTree &tree, bool checkRecords = true);
+    TreeReport analyze(int numThreads = 0) const; // 0 for one thread per hardware thread
+    void printSummary(const TreeReport &report) const;
+    // Level-order dump, one line per level and " | " between nodes, written while walking
+    void dumpLevelOrder(std::ostream &out) const;
+    static size_t nodeBytes(); // memory of one Node, its arrays included
+
+private:
+    const BPlusTree &tree;
+    bool checkRecords;
+
+    struct Bounds
+    {
+        bool hasLow, hasHigh;
+        int low, high; // keys must be in [low, high)
+    };
+
+    void checkNode(const Node *node, int depth, const Bounds &bounds, TreeReport &report, std::vector<const Node *> &leaves) const;
+    void walk(const Node *node, int depth, const Bounds &bounds, TreeReport &report, std::vector<const Node *> &leaves) const;
+    static Bounds childBounds(const Node *node, int child, const Bounds &bounds);
+    static void addViolation(TreeReport &report, const std::string &message);
+    static void merge(TreeReport &into, const TreeReport &from);
+};
+
+// Analyze the B+ tree built in experiment 2, print the summary and write the level-order dump
+void experimentTreeAnalysis(const BPlusTree &tree);
+
+#endif // TREEANALYZER_H
@@ -0,0 +1,407 @@
+#include "WriteAheadLog.h"
+#include <chrono>
+#include <random>
+#include <algorithm>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Entry header: payload length, checksum, LSN, type
+static const size_t ENTRY_HEADER = 4 + 4 + 8 + 1;
+static const char CHECKPOINT_MAGIC[4] = {'C', 'K', 'P', 'T'};
+
+// FNV-1a over the LSN, type and payload of an entry
+static uint32_t entryChecksum(uint64_t lsn, uint8_t type, const unsigned char *payload, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const unsigned char *bytes, size_t count) {
+        for (size_t i = 0; i < count; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+    };
+    mix(reinterpret_cast<const unsigned char *>(&lsn), sizeof(lsn));
+    mix(&type, 1);
+    mix(payload, length);
+    return hash;
+}
+
+static void syncDescriptor(std::FILE *file)
+{
+    std::fflush(file);
+#ifdef _WIN32
+    _commit(_fileno(file));
+#else
+    fdatasync(fileno(file));
+#endif
+}
+
+WriteAheadLog::WriteAheadLog(const std::string &logFilename, const std::string &checkpointFilename, size_t groupCommitSize)
+    : logFilename(logFilename), checkpointFilename(checkpointFilename), log(nullptr), pendingEntries(0),
+      groupCommitSize(std::max(groupCommitSize, (size_t)1)), checkpointInterval(0), entriesSinceCheckpoint(0), nextLsn(1), syncs(0) {}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    flush();
+    if (log != nullptr)
+    {
+        std::fclose(log);
+    }
+}
+
+// Take a checkpoint after this many logged operations, 0 for never
+void WriteAheadLog::setCheckpointInterval(size_t entries)
+{
+    checkpointInterval = entries;
+}
+
+uint64_t WriteAheadLog::append(LogEntryType type, const void *payload, uint32_t length)
+{
+    uint64_t lsn = nextLsn++;
+    uint8_t typeByte = (uint8_t)type;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(payload);
+    uint32_t checksum = entryChecksum(lsn, typeByte, bytes, length);
+
+    size_t offset = pending.size();
+    pending.resize(offset + ENTRY_HEADER + length);
+    unsigned char *out = &pending[offset];
+    std::memcpy(out, &length, 4);
+    std::memcpy(out + 4, &checksum, 4);
+    std::memcpy(out + 8, &lsn, 8);
+    out[16] = typeByte;
+    std::memcpy(out + ENTRY_HEADER, bytes, length);
+
+    if (++pendingEntries >= groupCommitSize)
+    {
+        flush();
+    }
+    return lsn;
+}
+
+uint64_t WriteAheadLog::logInsert(const Record &record)
+{
+    return append(LOG_INSERT_RECORD, &record, sizeof(Record));
+}
+
+uint64_t WriteAheadLog::logDelete(int numVotes)
+{
+    return append(LOG_DELETE_KEY, &numVotes, sizeof(numVotes));
+}
+
+void WriteAheadLog::syncFile()
+{
+    syncDescriptor(log);
+    syncs++;
+}
+
+// Group commit: everything pending goes out with one write and one sync
+void WriteAheadLog::flush()
+{
+    if (pending.empty())
+    {
+        return;
+    }
+    if (log == nullptr)
+    {
+        log = std::fopen(logFilename.c_str(), "ab");
+        if (log == nullptr)
+        {
+            std::cerr << "Failed to open log file: " << logFilename << std::endl;
+            return;
+        }
+    }
+    std::fwrite(pending.data(), 1, pending.size(), log);
+    syncFile();
+    pending.clear();
+    pendingEntries = 0;
+}
+
+// Start an empty log once a checkpoint covers everything in it
+void WriteAheadLog::resetLog()
+{
+    if (log != nullptr)
+    {
+        std::fclose(log);
+    }
+    log = std::fopen(logFilename.c_str(), "wb");
+    if (log != nullptr)
+    {
+        syncFile();
+    }
+}
+
+bool WriteAheadLog::checkpoint(const BPlusTree &tree)
+{
+    flush();
+    uint64_t coveredLsn = nextLsn - 1;
+    std::vector<unsigned char *> live = tree.rangeSearch(INT_MIN, INT_MAX);
+    uint64_t count = live.size();
+
+    std::string temporary = checkpointFilename + ".tmp";
+    std::FILE *out = std::fopen(temporary.c_str(), "wb");
+    if (out == nullptr)
+    {
+        std::cerr << "Failed to open checkpoint file: " << temporary << std::endl;
+        return false;
+    }
+    std::fwrite(CHECKPOINT_MAGIC, 1, sizeof(CHECKPOINT_MAGIC), out);
+    std::fwrite(&coveredLsn, sizeof(coveredLsn), 1, out);
+    std::fwrite(&count, sizeof(count), 1, out);
+    for (unsigned char *record : live)
+    {
+        std::fwrite(record, sizeof(Record), 1, out);
+    }
+    syncDescriptor(out);
+    std::fclose(out);
+#ifdef _WIN32
+    std::remove(checkpointFilename.c_str());
+#endif
+    if (std::rename(temporary.c_str(), checkpointFilename.c_str()) != 0)
+    {
+        std::cerr << "Failed to install checkpoint: " << checkpointFilename << std::endl;
+        return false;
+    }
+
+    // Entries up to coveredLsn are skipped on replay even if the log is not emptied yet
+    resetLog();
+    entriesSinceCheckpoint = 0;
+    return true;
+}
+
+// Rebuild disk and tree from the checkpoint and the log, returning the number of log entries replayed.
+// Both start empty; recovery must run before anything new is logged. The log is cut back to its
+// last intact entry.
+size_t WriteAheadLog::recover(SimulatedDisk &disk, BPlusTree &tree)
+{
+    bool wasVerbose = tree.isVerbose();
+    tree.setVerbose(false);
+    uint64_t coveredLsn = 0;
+
+    std::FILE *in = std::fopen(checkpointFilename.c_str(), "rb");
+    if (in != nullptr)
+    {
+        char magic[4];
+        uint64_t count = 0;
+        if (std::fread(magic, 1, 4, in) == 4 && std::memcmp(magic, CHECKPOINT_MAGIC, 4) == 0 &&
+            std::fread(&coveredLsn, sizeof(coveredLsn), 1, in) == 1 && std::fread(&count, sizeof(count), 1, in) == 1)
+        {
+            Record record;
+            for (uint64_t i = 0; i < count && std::fread(&record, sizeof(Record), 1, in) == 1; i++)
+            {
+                disk.insertRecord(record);
+            }
+            std::vector<std::pair<int, unsigned char *>> entries = disk.numVotesEntries();
+            size_t next = 0;
+            tree.bulkLoad([&](int &key, unsigned char *&recordPtr) {
+                if (next == entries.size())
+                    return false;
+                key = entries[next].first;
+                recordPtr = entries[next].second;
+                next++;
+                return true;
+            });
+        }
+        std::fclose(in);
+    }
+
+    size_t replayed = 0;
+    long validBytes = 0;
+    uint64_t lastSeen = coveredLsn;
+    in = std::fopen(logFilename.c_str(), "rb");
+    if (in != nullptr)
+    {
+        unsigned char header[ENTRY_HEADER];
+        std::vector<unsigned char> payload;
+        while (std::fread(header, 1, ENTRY_HEADER, in) == ENTRY_HEADER)
+        {
+            uint32_t length, checksum;
+            uint64_t lsn;
+            std::memcpy(&length, header, 4);
+            std::memcpy(&checksum, header + 4, 4);
+            std::memcpy(&lsn, header + 8, 8);
+            uint8_t type = header[16];
+            if (length > sizeof(Record))
+                break;
+            payload.resize(length);
+            if (std::fread(payload.data(), 1, length, in) != length || entryChecksum(lsn, type, payload.data(), length) != checksum)
+                break; // torn write at the end of the log
+
+            validBytes += (long)(ENTRY_HEADER + length);
+            if (lsn <= coveredLsn)
+                continue;
+            lastSeen = lsn;
+            if (type == LOG_INSERT_RECORD && length == sizeof(Record))
+            {
+                Record record;
+                std::memcpy(&record, payload.data(), sizeof(Record));
+                Record *stored = disk.insertRecord(record);
+                if (stored != nullptr)
+                    tree.insertKey(stored->numVotes, reinterpret_cast<unsigned char *>(stored));
+            }
+            else if (type == LOG_DELETE_KEY && length == sizeof(int))
+            {
+                int numVotes;
+                std::memcpy(&numVotes, payload.data(), sizeof(int));
+                tree.deleteKey(numVotes);
+            }
+            replayed++;
+        }
+        std::fclose(in);
+    }
+
+    // Drop a torn tail so new entries follow the last intact one
+    log = std::fopen(logFilename.c_str(), "ab");
+    if (log != nullptr)
+    {
+        std::fflush(log);
+#ifdef _WIN32
+        _chsize_s(_fileno(log), validBytes);
+#else
+        if (ftruncate(fileno(log), validBytes) != 0)
+            std::cerr << "Failed to truncate log file: " << logFilename << std::endl;
+#endif
+    }
+    nextLsn = lastSeen + 1;
+    tree.setVerbose(wasVerbose);
+    return replayed;
+}
+
+Record *WriteAheadLog::insert(const Record &record, SimulatedDisk &disk, BPlusTree &tree)
+{
+    // Logged only once the disk has taken the record, so replay never brings back an
+    // insert that failed for lack of space
+    Record *stored = disk.insertRecord(record);
+    if (stored == nullptr)
+    {
+        return nullptr;
+    }
+    logInsert(record);
+    tree.insertKey(stored->numVotes, reinterpret_cast<unsigned char *>(stored));
+    if (checkpointInterval > 0 && ++entriesSinceCheckpoint >= checkpointInterval)
+    {
+        checkpoint(tree);
+    }
+    return stored;
+}
+
+void WriteAheadLog::deleteKey(int numVotes, BPlusTree &tree)
+{
+    logDelete(numVotes);
+    tree.deleteKey(numVotes);
+    if (checkpointInterval > 0 && ++entriesSinceCheckpoint >= checkpointInterval)
+    {
+        checkpoint(tree);
+    }
+}
+
+uint64_t WriteAheadLog::lastLsn() const
+{
+    return nextLsn - 1;
+}
+
+uint64_t WriteAheadLog::syncCount() const
+{
+    return syncs;
+}
+
+void experimentWriteAheadLog(int numOperations)
+{
+    const std::string logFile = "wal.log";
+    const std::string checkpointFile = "wal.checkpoint";
+
+    std::mt19937 rng(3020);
+    std::uniform_int_distribution<int> votes(1, 100000);
+    std::uniform_int_distribution<int> rating(10, 100);
+    std::vector<Record> records;
+    for (int i = 0; i < numOperations; i++)
+    {
+        char tconst[16];
+        std::snprintf(tconst, sizeof(tconst), "tw%07d", i % 10000000);
+        records.push_back(Record(tconst, rating(rng) / 10.0f, votes(rng)));
+    }
+
+    // In-memory baseline: the same inserts with no log
+    {
+        SimulatedDisk disk;
+        BPlusTree tree;
+        tree.setVerbose(false);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const Record &record : records)
+        {
+            Record *stored = disk.insertRecord(record);
+            tree.insertKey(stored->numVotes, reinterpret_cast<unsigned char *>(stored));
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> duration = end - start;
+        printHeader("Write-Ahead Log Group Commit");
+        printKeyValue("In memory, no log", std::to_string((long)(numOperations / duration.count())) + " ops/s");
+    }
+
+    // Small groups sync once per few operations, so they run fewer operations to keep the run short
+    for (size_t groupSize = 1; groupSize <= 1024; groupSize *= 4)
+    {
+        std::remove(logFile.c_str());
+        std::remove(checkpointFile.c_str());
+        int operations = (int)std::min((size_t)numOperations, groupSize * 500);
+        SimulatedDisk disk;
+        BPlusTree tree;
+        tree.setVerbose(false);
+        WriteAheadLog wal(logFile, checkpointFile, groupSize);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < operations; i++)
+        {
+            wal.insert(records[i], disk, tree);
+        }
+        wal.flush();
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> duration = end - start;
+        printKeyValue("Group commit of " + std::to_string(groupSize),
+                      std::to_string((long)(operations / duration.count())) + " ops/s (" + std::to_string(wal.syncCount()) + " syncs)");
+    }
+
+    // Recovery: inserts and deletes with periodic checkpoints, then rebuild from the files alone
+    std::remove(logFile.c_str());
+    std::remove(checkpointFile.c_str());
+    SimulatedDisk disk;
+    BPlusTree tree;
+    tree.setVerbose(false);
+    {
+        WriteAheadLog wal(logFile, checkpointFile, 64);
+        wal.setCheckpointInterval(numOperations / 3 + 1);
+        for (int i = 0; i < numOperations; i++)
+        {
+            wal.insert(records[i], disk, tree);
+            if (i % 10 == 9)
+                wal.deleteKey(records[i - 5].numVotes, tree);
+        }
+        wal.flush();
+    }
+
+    SimulatedDisk recoveredDisk;
+    BPlusTree recoveredTree;
+    WriteAheadLog wal(logFile, checkpointFile, 64);
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t replayed = wal.recover(recoveredDisk, recoveredTree);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> duration = end - start;
+
+    std::vector<unsigned char *> expected = tree.rangeSearch(INT_MIN, INT_MAX);
+    std::vector<unsigned char *> actual = recoveredTree.rangeSearch(INT_MIN, INT_MAX);
+    bool same = expected.size() == actual.size();
+    for (size_t i = 0; same && i < expected.size(); i++)
+    {
+        same = reinterpret_cast<Record *>(expected[i])->numVotes == reinterpret_cast<Record *>(actual[i])->numVotes;
+    }
+
+    printHeader("Recovery");
+    printKeyValue("Log entries replayed", std::to_string(replayed));
+    printKeyValue("Records indexed", std::to_string(actual.size()));
+    printKeyValue("Recovery time", std::to_string(duration.count()) + " milliseconds");
+    printKeyValue("Matches state before restart", same ? "yes" : "no");
+
+    std::remove(logFile.c_str());
+    std::remove(checkpointFile.c_str());
+}
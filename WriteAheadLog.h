@@ -0,0 +1,68 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include "Storage.h"
+#include "BPlusTree.h"
+
+// Kinds of change recorded in the log
+enum LogEntryType
+{
+    LOG_INSERT_RECORD = 1, // a record appended to the disk and indexed on numVotes
+    LOG_DELETE_KEY = 2     // a numVotes key removed from the index
+};
+
+// Append-only redo log for record and index changes.
+//
+// Every entry carries a sequence number (LSN) and a checksum. Entries are
+// buffered and written with a single write and fdatasync once groupCommitSize
+// of them are pending, or on flush(), so the cost of a sync is shared by a
+// whole group of operations. An operation is durable once its group is synced.
+//
+// A checkpoint writes every record still reachable from the index to the
+// checkpoint file, tagged with the last LSN it covers, and then empties the
+// log. recover() loads the checkpoint and replays the log entries after it,
+// stopping at the first torn or corrupt entry.
+class WriteAheadLog
+{
+    std::string logFilename;
+    std::string checkpointFilename;
+    std::FILE *log;
+    std::vector<unsigned char> pending;
+    size_t pendingEntries;
+    size_t groupCommitSize;
+    size_t checkpointInterval;
+    size_t entriesSinceCheckpoint;
+    uint64_t nextLsn;
+    uint64_t syncs;
+
+    uint64_t append(LogEntryType type, const void *payload, uint32_t length);
+    void syncFile();
+    void resetLog();
+
+public:
+    WriteAheadLog(const std::string &logFilename, const std::string &checkpointFilename, size_t groupCommitSize = 64);
+    ~WriteAheadLog();
+    void setCheckpointInterval(size_t entries);
+    uint64_t logInsert(const Record &record);
+    uint64_t logDelete(int numVotes);
+    void flush();
+    bool checkpoint(const BPlusTree &tree);
+    size_t recover(SimulatedDisk &disk, BPlusTree &tree);
+
+    // Log, then apply. An insert the disk has no room for returns nullptr and is not logged.
+    // A checkpoint is taken when the checkpoint interval is reached.
+    Record *insert(const Record &record, SimulatedDisk &disk, BPlusTree &tree);
+    void deleteKey(int numVotes, BPlusTree &tree);
+
+    uint64_t lastLsn() const;
+    uint64_t syncCount() const;
+};
+
+// Durable insert throughput for growing group-commit sizes against in-memory inserts, then a crash-free recovery check
+void experimentWriteAheadLog(int numOperations);
+
+#endif // WRITEAHEADLOG_H
@@ -0,0 +1,91 @@
+#include "ZoneMap.h"
+#include <climits>
+#include <cstring>
+#include <limits>
+
+ZoneMap::ZoneMap()
+    : minVotes(INT_MAX), maxVotes(INT_MIN),
+      minRating(std::numeric_limits<float>::max()), maxRating(-std::numeric_limits<float>::max()) {}
+
+void ZoneMap::add(const Record &record)
+{
+    if (record.numVotes < minVotes)
+        minVotes = record.numVotes;
+    if (record.numVotes > maxVotes)
+        maxVotes = record.numVotes;
+    if (record.averageRating < minRating)
+        minRating = record.averageRating;
+    if (record.averageRating > maxRating)
+        maxRating = record.averageRating;
+}
+
+bool ZoneMap::mayContainVotes(int lo, int hi) const
+{
+    return lo <= maxVotes && hi >= minVotes;
+}
+
+bool ZoneMap::mayContainRating(float lo, float hi) const
+{
+    return lo <= maxRating && hi >= minRating;
+}
+
+BloomFilter::BloomFilter()
+{
+    bits[0] = 0;
+    bits[1] = 0;
+}
+
+// The three probe positions are taken from 7-bit slices of the hash
+void BloomFilter::add(uint64_t hash)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        unsigned bit = (hash >> (i * 7)) & 127;
+        bits[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+bool BloomFilter::mayContain(uint64_t hash) const
+{
+    for (int i = 0; i < 3; i++)
+    {
+        unsigned bit = (hash >> (i * 7)) & 127;
+        if ((bits[bit >> 6] & (1ULL << (bit & 63))) == 0)
+            return false;
+    }
+    return true;
+}
+
+// splitmix64 finaliser
+uint64_t BloomFilter::hashVotes(int numVotes)
+{
+    uint64_t x = (uint64_t)(uint32_t)numVotes + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// FNV-1a over the tconst bytes
+uint64_t BloomFilter::hashTconst(const char *tconst)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(((Record *)0)->tconst) && tconst[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char)tconst[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash ^ (hash >> 29);
+}
+
+ScanPredicate::ScanPredicate()
+    : minVotes(INT_MIN), maxVotes(INT_MAX),
+      minRating(-std::numeric_limits<float>::max()), maxRating(std::numeric_limits<float>::max()) {}
+
+bool ScanPredicate::matches(const Record &record) const
+{
+    return record.numVotes >= minVotes && record.numVotes <= maxVotes &&
+           record.averageRating >= minRating && record.averageRating <= maxRating &&
+           (tconst.empty() || std::strncmp(record.tconst, tconst.c_str(), sizeof(record.tconst)) == 0);
+}
+
+ScanStats::ScanStats() : blocksAccessed(0), blocksPruned(0), recordsAccessed(0) {}
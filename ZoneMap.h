@@ -0,0 +1,66 @@
+#ifndef ZONEMAP_H
+#define ZONEMAP_H
+
+#include <cstdint>
+#include <string>
+#include "Record.h"
+
+// Min/max of the numVotes and averageRating columns within one block
+struct ZoneMap
+{
+    int minVotes;
+    int maxVotes;
+    float minRating;
+    float maxRating;
+
+    ZoneMap();
+    void add(const Record &record);
+    bool mayContainVotes(int lo, int hi) const;
+    bool mayContainRating(float lo, float hi) const;
+};
+
+// 128-bit Bloom filter with 3 probes, sized for the 10 records of a block
+class BloomFilter
+{
+    uint64_t bits[2];
+
+public:
+    BloomFilter();
+    void add(uint64_t hash);
+    bool mayContain(uint64_t hash) const;
+    static uint64_t hashVotes(int numVotes);
+    static uint64_t hashTconst(const char *tconst);
+};
+
+// Metadata kept next to every block for scan pruning
+struct BlockSummary
+{
+    ZoneMap zoneMap;
+    BloomFilter votesFilter;
+    BloomFilter tconstFilter;
+};
+
+// Conjunctive predicate understood by the block scan
+struct ScanPredicate
+{
+    int minVotes;
+    int maxVotes;
+    float minRating;
+    float maxRating;
+    std::string tconst; // empty matches every title
+
+    ScanPredicate();
+    bool matches(const Record &record) const;
+};
+
+// Per-scan counters
+struct ScanStats
+{
+    int blocksAccessed;
+    int blocksPruned;
+    int recordsAccessed;
+
+    ScanStats();
+};
+
+#endif // ZONEMAP_H
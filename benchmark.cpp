@@ -0,0 +1,359 @@
+// Non-interactive benchmark of the numVotes B+ tree.
+//
+// Every workload runs on freshly built trees over synthetic records: warmup runs first,
+// then the measured repetitions. Each operation is timed on its own, so the report has
+// latency percentiles next to throughput. Results are printed and written as JSON so
+// that runs of different versions can be compared.
+//
+// Usage: benchmark [--records N] [--keys K] [--zipf S] [--warmup W] [--reps R]
+//                  [--seed X] [--label TEXT] [--out FILE]
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include "Storage.h"
+#include "BPlusTree.h"
+#include "Instrumentation.h"
+
+struct BenchmarkConfig
+{
+    size_t records = 200000; // keys inserted by every build
+    int keySpace = 100000;   // keys are drawn from 1 to keySpace
+    double zipfExponent = 0.99;
+    int warmup = 1;
+    int repetitions = 5;
+    unsigned seed = 3020;
+    std::string label = "";
+    std::string outFilename = "benchmark.json";
+};
+
+struct WorkloadResult
+{
+    std::string name;
+    size_t operations;                // per repetition
+    std::vector<double> latencies;    // nanoseconds, every measured operation
+    std::vector<double> opsPerSecond; // one per repetition
+    uint64_t checksum;                // keeps the optimizer from dropping lookups
+};
+
+// Records the tree points at; every key gets a record with that numVotes
+class RecordPool
+{
+    SimulatedDisk disk;
+
+public:
+    std::vector<unsigned char *> make(const std::vector<int> &keys)
+    {
+        std::vector<unsigned char *> records;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            char tconst[16];
+            std::snprintf(tconst, sizeof(tconst), "bm%07zu", i % 10000000);
+            records.push_back(reinterpret_cast<unsigned char *>(disk.insertRecord(Record(tconst, 5.0f, keys[i]))));
+        }
+        return records;
+    }
+};
+
+// Zipf distribution over 1..n by inversion of the precomputed CDF; key 1 is the most frequent
+class ZipfGenerator
+{
+    std::vector<double> cdf;
+
+public:
+    ZipfGenerator(int n, double exponent)
+    {
+        double sum = 0.0;
+        for (int i = 1; i <= n; i++)
+        {
+            sum += 1.0 / std::pow((double)i, exponent);
+            cdf.push_back(sum);
+        }
+        for (double &value : cdf)
+        {
+            value /= sum;
+        }
+    }
+
+    int operator()(std::mt19937 &rng)
+    {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        return (int)(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) + 1;
+    }
+};
+
+static std::vector<int> uniformKeys(const BenchmarkConfig &config, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<int> dist(1, config.keySpace);
+    std::vector<int> keys;
+    for (size_t i = 0; i < config.records; i++)
+    {
+        keys.push_back(dist(rng));
+    }
+    return keys;
+}
+
+static std::vector<int> zipfKeys(const BenchmarkConfig &config, std::mt19937 &rng)
+{
+    ZipfGenerator zipf(config.keySpace, config.zipfExponent);
+    std::vector<int> keys;
+    for (size_t i = 0; i < config.records; i++)
+    {
+        keys.push_back(zipf(rng));
+    }
+    return keys;
+}
+
+static void build(BPlusTree &tree, const std::vector<int> &keys, const std::vector<unsigned char *> &records)
+{
+    tree.setVerbose(false);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        tree.insertKey(keys[i], records[i]);
+    }
+}
+
+// Run one workload warmup + repetitions times. prepare sets up a fresh tree outside the
+// timed region and returns the number of operations; operation(i) runs the i-th one.
+static WorkloadResult runWorkload(const std::string &name, const BenchmarkConfig &config,
+                                  const std::function<size_t()> &prepare,
+                                  const std::function<uint64_t(size_t)> &operation)
+{
+    WorkloadResult result;
+    result.name = name;
+    result.operations = 0;
+    result.checksum = 0;
+    for (int rep = 0; rep < config.warmup + config.repetitions; rep++)
+    {
+        size_t operations = prepare();
+        bool measured = rep >= config.warmup;
+        auto repStart = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < operations; i++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            result.checksum += operation(i);
+            auto end = std::chrono::high_resolution_clock::now();
+            if (measured)
+                result.latencies.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        }
+        std::chrono::duration<double> repDuration = std::chrono::high_resolution_clock::now() - repStart;
+        if (measured)
+        {
+            result.operations = operations;
+            result.opsPerSecond.push_back(repDuration.count() > 0 ? operations / repDuration.count() : 0.0);
+        }
+    }
+    return result;
+}
+
+static double median(std::vector<double> values)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+static std::string jsonString(const std::string &text)
+{
+    std::string escaped = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+static void report(std::vector<WorkloadResult> &results, const BenchmarkConfig &config)
+{
+    std::ofstream out(config.outFilename, std::ios::trunc);
+    out << "{\n  \"label\": " << jsonString(config.label) << ",\n";
+    out << "  \"config\": {\"records\": " << config.records << ", \"keySpace\": " << config.keySpace
+        << ", \"zipfExponent\": " << config.zipfExponent << ", \"warmup\": " << config.warmup
+        << ", \"repetitions\": " << config.repetitions << ", \"seed\": " << config.seed << "},\n";
+    out << "  \"workloads\": [\n";
+    out << std::fixed << std::setprecision(1);
+    for (size_t w = 0; w < results.size(); w++)
+    {
+        WorkloadResult &result = results[w];
+        LatencySummary latency = summarizeLatencies(result.latencies);
+        double throughput = median(result.opsPerSecond);
+
+        printKeyValue(result.name, std::to_string((long)throughput) + " ops/sec, p50 " + std::to_string((long)latency.p50) + " ns, p99 " +
+                                       std::to_string((long)latency.p99) + " ns, p99.9 " + std::to_string((long)latency.p999) + " ns");
+
+        out << "    {\"name\": " << jsonString(result.name) << ", \"operations\": " << result.operations
+            << ", \"throughput\": {\"median\": " << throughput
+            << ", \"min\": " << (result.opsPerSecond.empty() ? 0.0 : *std::min_element(result.opsPerSecond.begin(), result.opsPerSecond.end()))
+            << ", \"max\": " << (result.opsPerSecond.empty() ? 0.0 : *std::max_element(result.opsPerSecond.begin(), result.opsPerSecond.end()))
+            << "}, \"latencyNs\": {\"mean\": " << latency.mean << ", \"p50\": " << latency.p50 << ", \"p99\": " << latency.p99
+            << ", \"p99.9\": " << latency.p999 << ", \"max\": " << latency.max << "}, \"checksum\": " << result.checksum << "}"
+            << (w + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static bool parseArguments(int argc, char *argv[], BenchmarkConfig &config)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << option << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (option == "--records")
+            config.records = (size_t)std::stoul(value);
+        else if (option == "--keys")
+            config.keySpace = std::stoi(value);
+        else if (option == "--zipf")
+            config.zipfExponent = std::stod(value);
+        else if (option == "--warmup")
+            config.warmup = std::stoi(value);
+        else if (option == "--reps")
+            config.repetitions = std::stoi(value);
+        else if (option == "--seed")
+            config.seed = (unsigned)std::stoul(value);
+        else if (option == "--label")
+            config.label = value;
+        else if (option == "--out")
+            config.outFilename = value;
+        else
+        {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+    return config.records > 0 && config.keySpace > 0 && config.repetitions > 0 && config.warmup >= 0;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkConfig config;
+    try
+    {
+        if (!parseArguments(argc, argv, config))
+        {
+            std::cerr << "Usage: benchmark [--records N] [--keys K] [--zipf S] [--warmup W] [--reps R] [--seed X] [--label TEXT] [--out FILE]" << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Invalid argument: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Key sets and their records are generated once; every repetition builds new trees over them
+    std::mt19937 rng(config.seed);
+    std::vector<int> uniform = uniformKeys(config, rng);
+    std::vector<int> zipf = zipfKeys(config, rng);
+    std::vector<int> sorted = uniform;
+    std::sort(sorted.begin(), sorted.end());
+    RecordPool pool;
+    std::vector<unsigned char *> uniformRecords = pool.make(uniform);
+    std::vector<unsigned char *> zipfRecords = pool.make(zipf);
+    std::vector<unsigned char *> sortedRecords = pool.make(sorted);
+
+    std::vector<WorkloadResult> results;
+    std::unique_ptr<BPlusTree> tree;
+    auto freshTree = [&]() {
+        tree.reset(new BPlusTree());
+        tree->setVerbose(false);
+    };
+
+    // Inserts
+    auto insertWorkload = [&](const std::string &name, const std::vector<int> &keys, const std::vector<unsigned char *> &records) {
+        results.push_back(runWorkload(name, config,
+                                      [&]() { freshTree(); return keys.size(); },
+                                      [&](size_t i) { tree->insertKey(keys[i], records[i]); return (uint64_t)0; }));
+    };
+    insertWorkload("insert_uniform", uniform, uniformRecords);
+    insertWorkload("insert_zipf", zipf, zipfRecords);
+    insertWorkload("insert_sorted", sorted, sortedRecords);
+
+    // Point lookups read every record of the posting list
+    std::vector<int> probes;
+    auto lookupWorkload = [&](const std::string &name, const std::vector<int> &keys, const std::vector<unsigned char *> &records) {
+        results.push_back(runWorkload(name, config,
+                                      [&]() {
+                                          freshTree();
+                                          build(*tree, keys, records);
+                                          probes.clear();
+                                          std::mt19937 probeRng(config.seed + 1);
+                                          for (size_t i = 0; i < std::min(keys.size(), (size_t)100000); i++)
+                                          {
+                                              probes.push_back(keys[probeRng() % keys.size()]);
+                                          }
+                                          return probes.size();
+                                      },
+                                      [&](size_t i) {
+                                          uint64_t sum = 0;
+                                          for (PostingIterator it = tree->lookup(probes[i]); it.valid(); ++it)
+                                          {
+                                              sum += reinterpret_cast<uintptr_t>(*it);
+                                          }
+                                          return sum;
+                                      }));
+    };
+    lookupWorkload("lookup_uniform", uniform, uniformRecords);
+    lookupWorkload("lookup_zipf", zipf, zipfRecords);
+
+    // Range searches over the uniform keys, by the fraction of the key space they cover
+    const double selectivities[4] = {0.0001, 0.001, 0.01, 0.1};
+    const size_t rangeCounts[4] = {10000, 10000, 1000, 100};
+    std::vector<std::pair<int, int>> ranges;
+    for (int s = 0; s < 4; s++)
+    {
+        int width = std::max(1, (int)(selectivities[s] * config.keySpace));
+        char name[32];
+        std::snprintf(name, sizeof(name), "range_%g%%", selectivities[s] * 100);
+        results.push_back(runWorkload(name, config,
+                                      [&]() {
+                                          freshTree();
+                                          build(*tree, uniform, uniformRecords);
+                                          ranges.clear();
+                                          std::mt19937 rangeRng(config.seed + 2);
+                                          std::uniform_int_distribution<int> startDist(1, std::max(1, config.keySpace - width + 1));
+                                          for (size_t i = 0; i < rangeCounts[s]; i++)
+                                          {
+                                              int start = startDist(rangeRng);
+                                              ranges.push_back(std::make_pair(start, start + width - 1));
+                                          }
+                                          return ranges.size();
+                                      },
+                                      [&](size_t i) { return (uint64_t)tree->rangeSearch(ranges[i].first, ranges[i].second).size(); }));
+    }
+
+    // Deletes of distinct keys in random order, each removing the whole posting list
+    std::vector<int> victims;
+    results.push_back(runWorkload("delete_uniform", config,
+                                  [&]() {
+                                      freshTree();
+                                      build(*tree, uniform, uniformRecords);
+                                      victims = uniform;
+                                      std::sort(victims.begin(), victims.end());
+                                      victims.erase(std::unique(victims.begin(), victims.end()), victims.end());
+                                      std::shuffle(victims.begin(), victims.end(), std::mt19937(config.seed + 3));
+                                      if (victims.size() > 100000)
+                                          victims.resize(100000);
+                                      return victims.size();
+                                  },
+                                  [&](size_t i) { tree->deleteKey(victims[i]); return (uint64_t)0; }));
+
+    printHeader("Benchmark" + (config.label.empty() ? std::string() : " " + config.label));
+    printKeyValue("Records per build", std::to_string(config.records) + ", keys 1 to " + std::to_string(config.keySpace));
+    printKeyValue("Repetitions", std::to_string(config.repetitions) + " measured after " + std::to_string(config.warmup) + " warmup");
+    report(results, config);
+    printKeyValue("Results written to", config.outFilename);
+    return 0;
+}
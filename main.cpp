@@ -8,20 +8,59 @@
 #include <iomanip>
 #include "Storage.h"
 #include "Record.h"
+#include "PrefixBPlusTree.h"
+#include "HashIndex.h"
+#include "BlockReader.h"
+#include "QueryPlanner.h"
+#include "Query.h"
+#include "Aggregation.h"
+#include "Join.h"
+#include "ExternalSort.h"
+#include "WriteAheadLog.h"
+#include "CowBPlusTree.h"
+#include "CompressedLeafTree.h"
+#include "StaticBTree.h"
+#include "StreamIngest.h"
+#include "ShardedIndex.h"
+#include "Instrumentation.h"
+#include "TreeAnalyzer.h"
 
 int main() {
     int choice = 0;
     std::string filename = "Data/data.tsv"; // Specify the path to your TSV file
-    SimulatedDisk disk(DISK_CAPACITY); // Initialize the simulated disk
+    SimulatedDisk disk(DISK_CAPACITY, true); // Initialize the simulated disk with per-block Bloom filters
     BPlusTree bptree; //initialise bptree
+    ColumnStatistics votesStats; // numVotes histogram for the query planner
 
     do {
-        std::cout << "\nSelect an experiment to run (1-5) or 0 to exit:\n";
+        std::cout << "\nSelect an experiment to run (1-27) or 0 to exit:\n";
         std::cout << "1. Experiment 1: Storage Statistics\n";
         std::cout << "2. Experiment 2: B+ Tree Statistics\n";
         std::cout << "3. Experiment 3: Query for numVotes = 500\n";
         std::cout << "4. Experiment 4: Range Query for numVotes between 30,000 and 40,000\n";
         std::cout << "5. Experiment 5: Deletion of records with numVotes = 1,000\n";
+        std::cout << "6. Experiment 6: Prefix-compressed tconst index\n";
+        std::cout << "7. Experiment 7: Hash index point lookups on tconst\n";
+        std::cout << "8. Experiment 8: Cluster data blocks by numVotes\n";
+        std::cout << "9. Experiment 9: Asynchronous block prefetch for range scans\n";
+        std::cout << "10. Experiment 10: Batched numVotes point lookups\n";
+        std::cout << "11. Experiment 11: Multi-key numVotes lookup (IN-list)\n";
+        std::cout << "12. Experiment 12: Cost-based access path selection\n";
+        std::cout << "13. Experiment 13: Top 100 titles by numVotes\n";
+        std::cout << "14. Experiment 14: Multi-predicate queries with aggregates\n";
+        std::cout << "15. Experiment 15: Parallel group-by aggregation\n";
+        std::cout << "16. Experiment 16: Join ratings with title.basics on tconst\n";
+        std::cout << "17. Experiment 17: External merge sort and bulk load (1 MiB budget)\n";
+        std::cout << "18. Experiment 18: Write-ahead log with group commit\n";
+        std::cout << "19. Experiment 19: Snapshot reads during batched deletes\n";
+        std::cout << "20. Experiment 20: Frame-of-reference compressed leaves\n";
+        std::cout << "21. Experiment 21: Static B-tree export for read-only workloads\n";
+        std::cout << "22. Experiment 22: Tail-follow ingest of appended TSV rows\n";
+        std::cout << "23. Experiment 23: Split policies for sorted and random inserts\n";
+        std::cout << "24. Experiment 24: Delete, refill and compact records on the disk\n";
+        std::cout << "25. Experiment 25: Range-partitioned sharded index\n";
+        std::cout << "26. Experiment 26: Dump hot-path instrumentation counters\n";
+        std::cout << "27. Experiment 27: Analyze the B+ tree and check its invariants\n";
         std::cout << "0. Exit\n";
         std::cout << "> ";
         std::cin >> choice;
@@ -43,23 +82,114 @@ int main() {
                 printHeader("Disk Usage");
                 printKeyValue("Number of blocks for storing the data", std::to_string(disk.totalBlocks()));
                 printKeyValue("Used disk capacity", std::to_string(disk.usedCapacity()) + " bytes");
+                printKeyValue("Live record bytes", std::to_string(disk.liveBytes()) + " bytes");
+                printKeyValue("Dead record bytes", std::to_string(disk.deadBytes()) + " bytes");
+                printKeyValue("Blocks with free slots", std::to_string(disk.blocksWithHoles()));
                 printKeyValue("Total disk capacity", std::to_string(DISK_CAPACITY) + " bytes");
                 printKeyValue("Free disk capacity", std::to_string(DISK_CAPACITY - disk.usedCapacity()) + " bytes");
                 break;
             }
             case 2:{
                 disk.loadBPlusTree(bptree); // load bplustree based on numvotes from storage
+                votesStats.build(disk);
                 bptree.experiment2(); // print stats for Experiment 2
                 break;
             }
             case 3:
-                bptree.experiment3(500);
+                explainQuery(votesStats, bptree, disk, 500, 500); // both paths below run for comparison
+                bptree.experiment3(500, disk);
                 break;
             case 4:
-                bptree.experiment4(30000,40000);
+                explainQuery(votesStats, bptree, disk, 30000, 40000);
+                bptree.experiment4(30000, 40000, disk);
                 break;
-            case 5:
-                bptree.experiment5(1000);
+            case 5: {
+                bptree.experiment5(1000, disk);
+                votesStats.build(disk);
+                break;
+            }
+            case 6:
+                experimentPrefixCompression(disk);
+                break;
+            case 7:
+                experimentHashIndex(disk);
+                break;
+            case 8: {
+                std::unordered_map<unsigned char *, unsigned char *> relocated;
+                auto start = std::chrono::high_resolution_clock::now();
+                disk.reorganize(SORT_BY_NUM_VOTES, relocated);
+                bptree.remapRecords(relocated);
+                votesStats.build(disk);
+                auto end = std::chrono::high_resolution_clock::now();
+                std::chrono::duration<double, std::milli> duration = end - start;
+
+                printHeader("Clustered Reorganization");
+                printKeyValue("Records relocated", std::to_string(relocated.size()));
+                printKeyValue("Number of blocks", std::to_string(disk.totalBlocks()));
+                printKeyValue("Reorganization time", std::to_string(duration.count()) + " milliseconds");
+                std::cout << "Run experiments 3 and 4 again to compare the data blocks read.\n";
+                break;
+            }
+            case 9:
+                experimentAsyncPrefetch(bptree, disk);
+                break;
+            case 10:
+                bptree.experimentBatchedLookups(1000000);
+                break;
+            case 11:
+                bptree.experimentMultiSearch(5000);
+                break;
+            case 12:
+                experimentQueryPlanner(bptree, disk, votesStats);
+                break;
+            case 13:
+                bptree.experimentTopK(100, disk);
+                break;
+            case 14:
+                experimentMultiPredicateQueries(bptree, disk, votesStats);
+                break;
+            case 15:
+                experimentGroupBy(disk);
+                break;
+            case 16:
+                experimentJoins(disk, "Data/title.basics.tsv");
+                break;
+            case 17:
+                experimentExternalSort(1024 * 1024);
+                break;
+            case 18:
+                experimentWriteAheadLog(20000);
+                break;
+            case 19:
+                experimentSnapshotReads(disk);
+                break;
+            case 20:
+                experimentCompressedLeaves(disk);
+                break;
+            case 21:
+                experimentStaticBTree(bptree);
+                break;
+            case 22:
+                experimentStreamingIngest(disk);
+                break;
+            case 23:
+                experimentSplitPolicies(disk);
+                break;
+            case 24: {
+                experimentCompaction(disk, bptree);
+                votesStats.build(disk);
+                break;
+            }
+            case 25:
+                experimentShardedIndex(disk);
+                break;
+            case 26: {
+                dumpInstrumentation();
+                resetInstrumentation();
+                break;
+            }
+            case 27:
+                experimentTreeAnalysis(bptree);
                 break;
             default:
                 break;
@@ -1,4 +1,7 @@
 #include "Storage.h"
+#include <chrono>
+#include <climits>
+#include <cstdio>
 
 const int BLOCK_SIZE = 200;
 const size_t DISK_CAPACITY = 100 * 1024 * 1024;
@@ -51,12 +54,20 @@ void printKeyValue(const std::string &key, const std::string &value)
     std::cout << std::left << std::setw(30) << key << ": " << value << "\n";
 }
 
+// Every block takes exactly BLOCK_SIZE bytes in the data file so block i starts
+// at offset i * BLOCK_SIZE. Unused slots are zero filled (empty tconst).
 void Block::writeToDisk(std::ofstream &out) const
 {
     for (const Record &record : records)
     {
         out.write(reinterpret_cast<const char *>(&record), sizeof(Record));
     }
+    size_t padding = BLOCK_SIZE - records.size() * sizeof(Record);
+    if (padding > 0)
+    {
+        std::vector<char> zeros(padding, 0);
+        out.write(zeros.data(), zeros.size());
+    }
 }
 
 bool Block::canAddRecord() const
@@ -77,7 +88,40 @@ size_t Block::size() const
     return records.size();
 }
 
-SimulatedDisk::SimulatedDisk(size_t diskCapacity) : capacity(diskCapacity) {}
+size_t Block::liveCount() const
+{
+    size_t live = 0;
+    for (const Record &record : records)
+    {
+        if (!record.isDeleted())
+            live++;
+    }
+    return live;
+}
+
+// The slot is zero filled instead of erased so that the records after it keep their address
+bool Block::deleteRecord(size_t slot)
+{
+    if (slot >= records.size() || records[slot].isDeleted())
+    {
+        return false;
+    }
+    std::memset(&records[slot], 0, sizeof(Record));
+    return true;
+}
+
+long Block::freeSlot() const
+{
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (records[i].isDeleted())
+            return (long)i;
+    }
+    return -1;
+}
+
+SimulatedDisk::SimulatedDisk(size_t diskCapacity, bool buildBloomFilters)
+    : capacity(diskCapacity), bloomFilters(buildBloomFilters) {}
 
 bool SimulatedDisk::canAddBlock() const
 {
@@ -89,6 +133,12 @@ void SimulatedDisk::addBlock(const Block &block)
     if (canAddBlock())
     {
         blocks.push_back(block);
+        blocks.back().records.reserve(BLOCK_SIZE / sizeof(Record)); // room to append without moving records
+        summaries.push_back(summarize(block));
+        addressIndex.clear();
+        freeSlots.push_back((unsigned char)(block.size() - block.liveCount()));
+        if (freeSlots.back() > 0)
+            blocksWithFreeSlots.insert(blocks.size() - 1);
     }
     else
     {
@@ -96,6 +146,39 @@ void SimulatedDisk::addBlock(const Block &block)
     }
 }
 
+// Store one record in the slot of a deleted record if the free-space map has one,
+// lowest block first, otherwise append it to the last block, or to a new block when
+// it is full. Blocks are given room for a full block of records when added, so
+// appending never moves records that the B+ tree points at. Returns nullptr when the disk is full.
+Record *SimulatedDisk::insertRecord(const Record &record)
+{
+    if (!blocksWithFreeSlots.empty())
+    {
+        size_t blockId = *blocksWithFreeSlots.begin();
+        Record &slot = blocks[blockId].records[blocks[blockId].freeSlot()];
+        slot = record;
+        addToSummary(summaries[blockId], record);
+        if (--freeSlots[blockId] == 0)
+            blocksWithFreeSlots.erase(blockId);
+        return &slot;
+    }
+    if (blocks.empty() || !blocks.back().canAddRecord() || blocks.back().records.size() == blocks.back().records.capacity())
+    {
+        if (!canAddBlock())
+        {
+            std::cerr << "Disk capacity exceeded, cannot add more blocks." << std::endl;
+            return nullptr;
+        }
+        Block block;
+        block.addRecord(record);
+        addBlock(block);
+        return &blocks.back().records.back();
+    }
+    blocks.back().addRecord(record);
+    addToSummary(summaries.back(), record);
+    return &blocks.back().records.back();
+}
+
 void SimulatedDisk::writeToDisk(const std::string &filename)
 {
     std::ofstream outFile(filename, std::ios::binary);
@@ -121,7 +204,7 @@ size_t SimulatedDisk::totalRecords() const
     size_t total = 0;
     for (const Block &block : blocks)
     {
-        total += block.size();
+        total += block.liveCount();
     }
     return total;
 }
@@ -131,19 +214,345 @@ size_t SimulatedDisk::usedCapacity() const
     return blocks.size() * BLOCK_SIZE;
 }
 
-void readTSVAndCreateBlocks(const std::string &filename, SimulatedDisk &disk)
+size_t SimulatedDisk::liveBytes() const
+{
+    return totalRecords() * sizeof(Record);
+}
+
+// Bytes held by deleted records until their slot is reused or the block is compacted
+size_t SimulatedDisk::deadBytes() const
+{
+    size_t dead = 0;
+    for (unsigned char count : freeSlots)
+    {
+        dead += count;
+    }
+    return dead * sizeof(Record);
+}
+
+size_t SimulatedDisk::blocksWithHoles() const
+{
+    return blocksWithFreeSlots.size();
+}
+
+std::vector<Block> &SimulatedDisk::getBlocks()
+{
+    return blocks;
+}
+
+const std::vector<Block> &SimulatedDisk::getBlocks() const
+{
+    return blocks;
+}
+
+Record *SimulatedDisk::getRecord(const RecordLocation &location)
+{
+    if (location.blockId >= blocks.size() || location.slot >= blocks[location.blockId].size())
+    {
+        return nullptr;
+    }
+    return &blocks[location.blockId].records[location.slot];
+}
+
+BlockSummary SimulatedDisk::summarize(const Block &block) const
+{
+    BlockSummary summary;
+    for (const Record &record : block.records)
+    {
+        if (!record.isDeleted())
+            addToSummary(summary, record);
+    }
+    return summary;
+}
+
+void SimulatedDisk::addToSummary(BlockSummary &summary, const Record &record) const
+{
+    summary.zoneMap.add(record);
+    if (bloomFilters)
+    {
+        summary.votesFilter.add(BloomFilter::hashVotes(record.numVotes));
+        summary.tconstFilter.add(BloomFilter::hashTconst(record.tconst));
+    }
+}
+
+const BlockSummary &SimulatedDisk::getSummary(size_t blockId) const
+{
+    return summaries[blockId];
+}
+
+// Recompute every block summary after the blocks were rewritten in place
+void SimulatedDisk::rebuildSummaries()
+{
+    summaries.clear();
+    for (const Block &block : blocks)
+    {
+        summaries.push_back(summarize(block));
+    }
+}
+
+void SimulatedDisk::rebuildFreeSpaceMap()
+{
+    freeSlots.clear();
+    blocksWithFreeSlots.clear();
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        freeSlots.push_back((unsigned char)(blocks[i].size() - blocks[i].liveCount()));
+        if (freeSlots.back() > 0)
+            blocksWithFreeSlots.insert(i);
+    }
+}
+
+// Sequential scan that skips blocks whose summary rules out the predicate
+void SimulatedDisk::scan(const ScanPredicate &predicate, const std::function<void(const Record &)> &visit, ScanStats &stats) const
+{
+    bool votesEquality = predicate.minVotes == predicate.maxVotes;
+    uint64_t votesHash = BloomFilter::hashVotes(predicate.minVotes);
+    uint64_t tconstHash = BloomFilter::hashTconst(predicate.tconst.c_str());
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        const BlockSummary &summary = summaries[i];
+        bool pruned = !summary.zoneMap.mayContainVotes(predicate.minVotes, predicate.maxVotes) ||
+                      !summary.zoneMap.mayContainRating(predicate.minRating, predicate.maxRating);
+        if (!pruned && bloomFilters)
+        {
+            pruned = (votesEquality && !summary.votesFilter.mayContain(votesHash)) ||
+                     (!predicate.tconst.empty() && !summary.tconstFilter.mayContain(tconstHash));
+        }
+        if (pruned)
+        {
+            stats.blocksPruned++;
+            continue;
+        }
+
+        stats.blocksAccessed++;
+        for (const Record &record : blocks[i].records)
+        {
+            stats.recordsAccessed++;
+            if (!record.isDeleted() && predicate.matches(record))
+            {
+                visit(record);
+            }
+        }
+    }
+}
+
+// Find the block holding a record from its address, -1 if it is not on this disk
+long SimulatedDisk::blockIdOf(const unsigned char *recordPtr) const
+{
+    if (addressIndex.size() != blocks.size())
+    {
+        addressIndex.clear();
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            addressIndex.push_back(std::make_pair(blocks[i].records.data(), i));
+        }
+        std::sort(addressIndex.begin(), addressIndex.end());
+    }
+
+    const Record *record = reinterpret_cast<const Record *>(recordPtr);
+    auto it = std::upper_bound(addressIndex.begin(), addressIndex.end(), std::make_pair(record, blocks.size()));
+    if (it == addressIndex.begin())
+    {
+        return -1;
+    }
+    --it;
+    const Block &block = blocks[it->second];
+    if (record >= block.records.data() + block.records.size())
+    {
+        return -1;
+    }
+    return (long)it->second;
+}
+
+// Delete the record at recordPtr, leaving a tombstone in its slot that the next
+// insertRecord can fill. The block summary is left as it is: it may still cover
+// the deleted values, which only costs a block read that finds nothing.
+bool SimulatedDisk::deleteRecord(const unsigned char *recordPtr)
+{
+    long blockId = blockIdOf(recordPtr);
+    if (blockId < 0)
+    {
+        return false;
+    }
+    Block &block = blocks[blockId];
+    if (!block.deleteRecord(reinterpret_cast<const Record *>(recordPtr) - block.records.data()))
+    {
+        return false;
+    }
+    freeSlots[blockId]++;
+    blocksWithFreeSlots.insert(blockId);
+    return true;
+}
+
+// Drop the blocks whose live records fill less than maxLiveFraction of a block and
+// store their records again, in the free slots of the remaining blocks first, then
+// in new blocks at the end. Records in the remaining blocks do not move, so relocated
+// only receives the old -> new address of the moved ones. Returns the number of blocks freed.
+size_t SimulatedDisk::compact(double maxLiveFraction, std::unordered_map<unsigned char *, unsigned char *> &relocated)
+{
+    relocated.clear();
+    const double recordsPerBlock = BLOCK_SIZE / sizeof(Record);
+    std::vector<bool> sparse(blocks.size());
+    bool anySparse = false;
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        sparse[i] = blocks[i].liveCount() < maxLiveFraction * recordsPerBlock;
+        anySparse = anySparse || sparse[i];
+    }
+    if (!anySparse)
+    {
+        return 0;
+    }
+
+    // Moving a Block keeps its records where they are, so the dropped blocks
+    // stay readable while their records are copied out
+    size_t blocksBefore = blocks.size();
+    std::vector<Block> kept, dropped;
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        if (sparse[i])
+            dropped.push_back(std::move(blocks[i]));
+        else
+            kept.push_back(std::move(blocks[i]));
+    }
+    blocks.swap(kept);
+    addressIndex.clear();
+    rebuildSummaries();
+    rebuildFreeSpaceMap();
+
+    for (Block &block : dropped)
+    {
+        for (Record &record : block.records)
+        {
+            if (record.isDeleted())
+                continue;
+            Record *stored = insertRecord(record);
+            relocated[reinterpret_cast<unsigned char *>(&record)] = reinterpret_cast<unsigned char *>(stored);
+        }
+    }
+    return blocksBefore - blocks.size();
+}
+
+std::vector<Record *> SimulatedDisk::liveRecords() const
+{
+    std::vector<Record *> live;
+    live.reserve(totalRecords());
+    for (const Block &block : blocks)
+    {
+        for (const Record &record : block.records)
+        {
+            if (!record.isDeleted()) // deleted slots are zero filled tombstones
+                live.push_back(const_cast<Record *>(&record));
+        }
+    }
+    return live;
+}
+
+std::vector<Record *> SimulatedDisk::sortedLiveRecords(SortColumn column) const
+{
+    std::vector<Record *> order = liveRecords();
+    std::stable_sort(order.begin(), order.end(), [column](const Record *a, const Record *b) {
+        switch (column)
+        {
+        case SORT_BY_AVERAGE_RATING:
+            return a->averageRating < b->averageRating;
+        case SORT_BY_TCONST:
+            return std::strncmp(a->tconst, b->tconst, sizeof(a->tconst)) < 0;
+        default:
+            return a->numVotes < b->numVotes;
+        }
+    });
+    return order;
+}
+
+std::vector<std::pair<int, unsigned char *>> SimulatedDisk::numVotesEntries(bool sorted) const
+{
+    std::vector<Record *> records = sorted ? sortedLiveRecords(SORT_BY_NUM_VOTES) : liveRecords();
+    std::vector<std::pair<int, unsigned char *>> entries;
+    entries.reserve(records.size());
+    for (Record *record : records)
+    {
+        entries.push_back(std::make_pair(record->numVotes, reinterpret_cast<unsigned char *>(record)));
+    }
+    return entries;
+}
+
+// Rewrite the data file sorted on a column so that key ranges map to contiguous blocks.
+// relocated receives the old -> new address of every record for fixing up index payloads.
+void SimulatedDisk::reorganize(SortColumn column, std::unordered_map<unsigned char *, unsigned char *> &relocated)
+{
+    std::vector<Record *> order = sortedLiveRecords(column);
+
+    std::vector<Block> clustered;
+    Block currentBlock;
+    for (Record *record : order)
+    {
+        if (!currentBlock.canAddRecord())
+        {
+            clustered.push_back(currentBlock);
+            currentBlock = Block();
+        }
+        currentBlock.addRecord(*record);
+    }
+    if (currentBlock.size() > 0)
+    {
+        clustered.push_back(currentBlock);
+    }
+
+    // Addresses are only final once the blocks sit in the new vector
+    relocated.clear();
+    size_t next = 0;
+    for (Block &block : clustered)
+    {
+        for (Record &record : block.records)
+        {
+            relocated[reinterpret_cast<unsigned char *>(order[next++])] = reinterpret_cast<unsigned char *>(&record);
+        }
+    }
+
+    blocks.swap(clustered);
+    addressIndex.clear();
+    rebuildSummaries();
+    rebuildFreeSpaceMap();
+}
+
+void splitTSVLine(const std::string &line, std::vector<std::string> &fields)
+{
+    fields.clear();
+    std::istringstream iss(line);
+    std::string field;
+    while (std::getline(iss, field, '\t'))
+    {
+        fields.push_back(field);
+    }
+}
+
+Record recordFromTSVFields(const std::vector<std::string> &fields, const std::string &line)
+{
+    std::string tconst = fields.size() > 0 ? fields[0] : "";
+    std::string rating = fields.size() > 1 ? fields[1] : "";
+    std::string votes = fields.size() > 2 ? fields[2] : "";
+
+    float avgRating = convertToFloat(rating, line);
+    int numVotes = convertToInt(votes, line);
+
+    return Record(tconst, avgRating, numVotes);
+}
+
+size_t readTSVRows(const std::string &filename, const std::function<void(const std::vector<std::string> &, const std::string &)> &onRow)
 {
     std::ifstream tsvFile(filename);
     std::string line;
-    Block currentBlock;
     size_t lineNumber = 0;
 
     if (!std::getline(tsvFile, line))
     {
         std::cerr << "File is empty or cannot be read." << std::endl;
-        return;
+        return 0;
     }
 
+    std::vector<std::string> fields;
     while (std::getline(tsvFile, line))
     {
         lineNumber++;
@@ -152,17 +561,22 @@ void readTSVAndCreateBlocks(const std::string &filename, SimulatedDisk &disk)
             std::cout << "Processing line: " << lineNumber << std::endl;
         }
 
-        std::istringstream iss(line);
-        std::string tconst, rating, votes;
+        splitTSVLine(line, fields);
+        onRow(fields, line);
+    }
 
-        std::getline(iss, tconst, '\t');
-        std::getline(iss, rating, '\t');
-        std::getline(iss, votes, '\t');
+    std::cout << "Finished processing. Total lines read: " << lineNumber << std::endl;
 
-        float avgRating = convertToFloat(rating, line);
-        int numVotes = convertToInt(votes, line);
+    tsvFile.close();
+    return lineNumber;
+}
 
-        Record record(tconst, avgRating, numVotes);
+void readTSVAndCreateBlocks(const std::string &filename, SimulatedDisk &disk)
+{
+    Block currentBlock;
+
+    readTSVRows(filename, [&](const std::vector<std::string> &fields, const std::string &line) {
+        Record record = recordFromTSVFields(fields, line);
 
         if (!currentBlock.canAddRecord())
         {
@@ -170,16 +584,12 @@ void readTSVAndCreateBlocks(const std::string &filename, SimulatedDisk &disk)
             currentBlock = Block();
         }
         currentBlock.addRecord(record);
-    }
+    });
 
     if (currentBlock.size() > 0)
     {
         disk.addBlock(currentBlock);
     }
-
-    std::cout << "Finished processing. Total lines read: " << lineNumber << std::endl;
-
-    tsvFile.close();
 }
 
 void SimulatedDisk::loadBPlusTree(BPlusTree &tree)
@@ -188,8 +598,110 @@ void SimulatedDisk::loadBPlusTree(BPlusTree &tree)
     {
         for (auto &record : block.records)
         {
+            if (record.isDeleted())
+                continue;
             unsigned char *recordPtr = reinterpret_cast<unsigned char *>(&record);
             tree.insertKey(record.numVotes, recordPtr);
         }
     }
 }
+
+void experimentCompaction(SimulatedDisk &disk, BPlusTree &tree)
+{
+    if (tree.height() == 0)
+    {
+        std::cout << "The B+ tree is empty, run experiment 2 first" << std::endl;
+        return;
+    }
+    const int maxDeletedVotes = 50;
+    const size_t refillRecords = 20000;
+    const double maxLiveFraction = 0.5;
+    bool wasVerbose = tree.isVerbose();
+    tree.setVerbose(false);
+
+    printHeader("Record Deletion");
+    printKeyValue("Blocks before", std::to_string(disk.totalBlocks()));
+    printKeyValue("Live records before", std::to_string(disk.totalRecords()));
+
+    // Every record of a key leaves the index and the disk together
+    std::vector<Record> deleted;
+    std::vector<int> keys;
+    for (unsigned char *recordPtr : tree.rangeSearch(INT_MIN, maxDeletedVotes))
+    {
+        const Record *record = reinterpret_cast<const Record *>(recordPtr);
+        if (keys.empty() || keys.back() != record->numVotes)
+            keys.push_back(record->numVotes);
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int key : keys)
+    {
+        std::vector<unsigned char *> records = tree.rangeSearch(key, key);
+        tree.deleteKey(key);
+        for (unsigned char *recordPtr : records)
+        {
+            deleted.push_back(*reinterpret_cast<const Record *>(recordPtr));
+            disk.deleteRecord(recordPtr);
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> deleteDuration = end - start;
+    printKeyValue("Records deleted", std::to_string(deleted.size()) + " (numVotes <= " + std::to_string(maxDeletedVotes) + ")");
+    printKeyValue("Deletion time", std::to_string(deleteDuration.count()) + " milliseconds");
+    printKeyValue("Live record bytes", std::to_string(disk.liveBytes()) + " bytes");
+    printKeyValue("Dead record bytes", std::to_string(disk.deadBytes()) + " bytes");
+    printKeyValue("Blocks with free slots", std::to_string(disk.blocksWithHoles()));
+
+    // New records copy deleted ones under new tconst values and go into the free slots
+    size_t blocksBefore = disk.totalBlocks();
+    size_t refilled = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < refillRecords && i < deleted.size(); i++)
+    {
+        char tconst[16];
+        std::snprintf(tconst, sizeof(tconst), "rf%07zu", i);
+        Record *stored = disk.insertRecord(Record(tconst, deleted[i].averageRating, deleted[i].numVotes));
+        if (stored == nullptr)
+            break;
+        tree.insertKey(stored->numVotes, reinterpret_cast<unsigned char *>(stored));
+        refilled++;
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> refillDuration = end - start;
+
+    printHeader("Refill");
+    printKeyValue("Records inserted", std::to_string(refilled));
+    printKeyValue("Blocks added", std::to_string(disk.totalBlocks() - blocksBefore));
+    printKeyValue("Insert time", std::to_string(refillDuration.count()) + " milliseconds");
+    printKeyValue("Dead record bytes", std::to_string(disk.deadBytes()) + " bytes");
+    printKeyValue("Blocks with free slots", std::to_string(disk.blocksWithHoles()));
+
+    std::unordered_map<unsigned char *, unsigned char *> relocated;
+    start = std::chrono::high_resolution_clock::now();
+    size_t freed = disk.compact(maxLiveFraction, relocated);
+    tree.remapRecords(relocated);
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> compactDuration = end - start;
+
+    // Every index entry must point at a live record of its key, and every live record must be indexed
+    size_t indexed = 0, wrong = 0;
+    for (unsigned char *recordPtr : tree.rangeSearch(INT_MIN, INT_MAX))
+    {
+        const Record *record = reinterpret_cast<const Record *>(recordPtr);
+        if (record->isDeleted() || disk.blockIdOf(recordPtr) < 0)
+            wrong++;
+        indexed++;
+    }
+
+    printHeader("Compaction");
+    printKeyValue("Sparse block threshold", std::to_string((int)(maxLiveFraction * 100)) + "% live");
+    printKeyValue("Blocks freed", std::to_string(freed));
+    printKeyValue("Records moved", std::to_string(relocated.size()));
+    printKeyValue("Compaction time", std::to_string(compactDuration.count()) + " milliseconds, index remap included");
+    printKeyValue("Blocks after", std::to_string(disk.totalBlocks()));
+    printKeyValue("Used disk capacity", std::to_string(disk.usedCapacity()) + " bytes");
+    printKeyValue("Live record bytes", std::to_string(disk.liveBytes()) + " bytes");
+    printKeyValue("Dead record bytes", std::to_string(disk.deadBytes()) + " bytes");
+    printKeyValue("Index entries", std::to_string(indexed) + " for " + std::to_string(disk.totalRecords()) + " live records");
+    printKeyValue("Dangling index entries", std::to_string(wrong));
+    tree.setVerbose(wasVerbose);
+}